@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Fixed-size histogram of how late events happen against when they were
+ * expected, for timer ticks and device interrupts. Recording is O(1) and
+ * needs no memory beyond the histogram, so it can sit in an interrupt
+ * handler for any number of events.
+ *
+ * Values are kept in buckets with BENCH_LATENCY_SUB_BITS bits of precision:
+ * exact below 2^(BENCH_LATENCY_SUB_BITS + 1), and within 1/8th above that.
+ * Percentiles are reported as the top of the bucket they fall in. Units are
+ * whatever the caller timestamps in.
+ */
+
+#define BENCH_LATENCY_SUB_BITS 3
+#define BENCH_LATENCY_BUCKETS ((64 - BENCH_LATENCY_SUB_BITS + 1) << BENCH_LATENCY_SUB_BITS)
+
+typedef struct {
+    /* events recorded, and how many happened before they were expected */
+    uint64_t count;
+    uint64_t early;
+    /* lateness of the events that were not early */
+    uint64_t min;
+    uint64_t max;
+    uint64_t sum;
+    uint32_t buckets[BENCH_LATENCY_BUCKETS];
+} bench_latency_t;
+
+void bench_latency_init(bench_latency_t *latency);
+
+/* record an event expected at expected that happened at actual. Early events
+ * are counted, but not added to the histogram. */
+void bench_latency_record(bench_latency_t *latency, uint64_t expected, uint64_t actual);
+
+/* the lateness percent of the late events are within */
+uint64_t bench_latency_percentile(const bench_latency_t *latency, unsigned int percent);
+
+/* print count, min/p50/p99/max/mean and jitter (max - min) on one line tagged
+ * with name, then each non-empty bucket if buckets is set */
+void bench_latency_print(const char *name, const char *unit, const bench_latency_t *latency, bool buckets);
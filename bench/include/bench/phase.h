@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stddef.h>
+#include <sel4bench/sel4bench.h>
+
+/*
+ * Cycle counts of the phases of a fixed sequence, such as a root task
+ * bringing up its environment. The caller marks the end of each phase,
+ * which is timed from the end of the one before, and prints the breakdown
+ * once done. Marking a phase is a read of the cycle counter.
+ *
+ * The caller must have called sel4bench_init first.
+ */
+
+/* most phases kept. Further phases are added to the last one. */
+#define BENCH_MAX_PHASES 16
+
+typedef struct {
+    const char *name;
+    ccnt_t cycles;
+} bench_phase_t;
+
+typedef struct {
+    ccnt_t start;
+    ccnt_t last;
+    size_t num_phases;
+    bench_phase_t phases[BENCH_MAX_PHASES];
+} bench_phases_t;
+
+/* start timing the first phase from now */
+void bench_phases_start(bench_phases_t *phases);
+
+/* end the current phase, naming it, and start the next */
+void bench_phase_end(bench_phases_t *phases, const char *name);
+
+/* print the cycles of each phase and its share of the total, each line
+ * tagged with name */
+void bench_phases_print(const char *name, const bench_phases_t *phases);
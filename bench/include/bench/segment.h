@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <sel4/sel4.h>
+#include <vka/vka.h>
+#include <vspace/vspace.h>
+#include <sel4utils/process.h>
+
+/*
+ * Map the segments of a process out of frames we already hold, for spawners
+ * that share a loaded image between processes instead of having sel4utils
+ * load each one.
+ *
+ * The process is configured with its segments' regions reserved but empty.
+ * Each segment is then mapped at its reservation, so it gets the rights the
+ * segment asks for. Its first pages are copies of caps to frames the caller
+ * keeps, the rest are fresh frames filled from the caller's bytes. Where the
+ * shared frames come from is up to the caller. Failing to allocate anything
+ * is fatal.
+ */
+
+/* sel4utils_configure_process_custom, but only reserving the regions of
+ * config.image_name's segments. config.do_elf_load is ignored. */
+void bench_segment_configure_process(sel4utils_process_t *process, vka_t *vka, vspace_t *vspace,
+                                     sel4utils_process_config_t config);
+
+/*
+ * Map the num pages at vstart in process, in region's reservation. Pages
+ * [0, num_shared) are mapped through copies of shared[0..num_shared), which
+ * are left alone when the process is destroyed. The remaining pages are
+ * fresh frames from vka, freed with the process: zeroed, with the len bytes
+ * at data copied in where they fall at or above data_vaddr. vspace is ours,
+ * to fill the fresh frames through.
+ */
+void bench_segment_map(sel4utils_process_t *process, sel4utils_elf_region_t *region, vka_t *vka,
+                       vspace_t *vspace, uintptr_t vstart, size_t num, const seL4_CPtr *shared,
+                       size_t num_shared, uintptr_t data_vaddr, const void *data, size_t len);
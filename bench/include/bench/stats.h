@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stddef.h>
+#include <sel4bench/sel4bench.h>
+
+/*
+ * Summary statistics over a set of cycle count samples, shared by the
+ * benchmarks in this repository.
+ */
+
+/* number of buckets in the histogram printed by bench_stats_print */
+#define BENCH_HIST_BUCKETS 10
+
+typedef struct {
+    size_t n;
+    ccnt_t min;
+    ccnt_t median;
+    ccnt_t p99;
+    ccnt_t max;
+    ccnt_t mean;
+} bench_stats_t;
+
+/* compute statistics over n samples. Sorts the samples in place. */
+void bench_stats(ccnt_t *samples, size_t n, bench_stats_t *stats);
+
+/* print the header for the lines printed by bench_stats_print */
+void bench_stats_print_header(void);
+
+/* compute statistics over n samples and print them on one line, tagged with
+ * name: min/median/p99/max followed by the sample counts of a histogram with
+ * BENCH_HIST_BUCKETS equal-width buckets between min and p99. Samples above
+ * p99 are counted in a final overflow bucket. Sorts the samples in place. */
+void bench_stats_print(const char *name, ccnt_t *samples, size_t n);
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <sel4/sel4.h>
+#include <sel4runtime/gen_config.h>
+
+/*
+ * Threads created at run time inside a capDL component. The component's spec
+ * provides an empty slot for the TCB, an IPC buffer frame mapped into the
+ * component and a cap to that frame, and a region to use as the stack.
+ */
+typedef struct {
+    /* empty slot to create the TCB in */
+    seL4_CPtr tcb;
+    /* IPC buffer of the thread, and the cap to the frame backing it */
+    seL4_CPtr ipc_frame;
+    seL4_IPCBuffer *ipc_buf;
+    /* top of the thread's stack */
+    uintptr_t stack_top;
+    char tls_region[CONFIG_SEL4RUNTIME_STATIC_TLS];
+} bench_thread_t;
+
+/* retype a TCB from untyped and configure it to run in the given cspace and
+ * vspace at prio, using auth_tcb as the priority authority. The thread is not
+ * started. */
+void bench_thread_create(bench_thread_t *thread, seL4_CPtr untyped, seL4_CPtr cnode,
+                         seL4_CPtr vspace, seL4_CPtr auth_tcb, seL4_Word prio);
+
+/* (re)start a created thread on core at fn(arg0, arg1). The core is ignored on
+ * single core kernels. */
+void bench_thread_start(bench_thread_t *thread, seL4_Word core, void *fn, void *arg0, void *arg1);
@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <utils/util.h>
+
+#include <bench/latency.h>
+
+#define EXACT_LIMIT BIT(BENCH_LATENCY_SUB_BITS + 1)
+
+static size_t bucket_of(uint64_t value)
+{
+    if (value < EXACT_LIMIT) {
+        return value;
+    }
+    /* keep the top BENCH_LATENCY_SUB_BITS bits below the most significant */
+    unsigned int shift = 63 - CLZLL(value) - BENCH_LATENCY_SUB_BITS;
+    return ((shift + 1) << BENCH_LATENCY_SUB_BITS) + ((value >> shift) & MASK(BENCH_LATENCY_SUB_BITS));
+}
+
+static uint64_t bucket_low(size_t bucket)
+{
+    if (bucket < EXACT_LIMIT) {
+        return bucket;
+    }
+    unsigned int shift = (bucket >> BENCH_LATENCY_SUB_BITS) - 1;
+    return (uint64_t)((bucket & MASK(BENCH_LATENCY_SUB_BITS)) | BIT(BENCH_LATENCY_SUB_BITS)) << shift;
+}
+
+static uint64_t bucket_high(size_t bucket)
+{
+    if (bucket < EXACT_LIMIT) {
+        return bucket;
+    }
+    unsigned int shift = (bucket >> BENCH_LATENCY_SUB_BITS) - 1;
+    return bucket_low(bucket) + ((1ull << shift) - 1);
+}
+
+void bench_latency_init(bench_latency_t *latency)
+{
+    *latency = (bench_latency_t) {
+        .min = UINT64_MAX,
+    };
+}
+
+void bench_latency_record(bench_latency_t *latency, uint64_t expected, uint64_t actual)
+{
+    latency->count++;
+    if (actual < expected) {
+        latency->early++;
+        return;
+    }
+    uint64_t late = actual - expected;
+    latency->min = MIN(latency->min, late);
+    latency->max = MAX(latency->max, late);
+    latency->sum += late;
+    latency->buckets[bucket_of(late)]++;
+}
+
+uint64_t bench_latency_percentile(const bench_latency_t *latency, unsigned int percent)
+{
+    uint64_t late = latency->count - latency->early;
+    /* rank of the event the percentile falls on, from 1 */
+    uint64_t rank = MAX(DIV_ROUND_UP(late * percent, 100), 1);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BENCH_LATENCY_BUCKETS; i++) {
+        seen += latency->buckets[i];
+        if (seen >= rank) {
+            return MIN(bucket_high(i), latency->max);
+        }
+    }
+    return latency->max;
+}
+
+void bench_latency_print(const char *name, const char *unit, const bench_latency_t *latency, bool buckets)
+{
+    uint64_t late = latency->count - latency->early;
+    if (late == 0) {
+        printf("%s: %llu events, %llu early\n", name, (unsigned long long) latency->count,
+               (unsigned long long) latency->early);
+        return;
+    }
+    printf("%s: %llu events, %llu early, late by min %llu p50 %llu p99 %llu max %llu mean %llu, "
+           "jitter %llu %s\n", name, (unsigned long long) latency->count, (unsigned long long) latency->early,
+           (unsigned long long) latency->min, (unsigned long long) bench_latency_percentile(latency, 50),
+           (unsigned long long) bench_latency_percentile(latency, 99), (unsigned long long) latency->max,
+           (unsigned long long)(latency->sum / late), (unsigned long long)(latency->max - latency->min), unit);
+    if (!buckets) {
+        return;
+    }
+    for (size_t i = 0; i < BENCH_LATENCY_BUCKETS; i++) {
+        if (latency->buckets[i] != 0) {
+            printf("    %llu..%llu: %u\n", (unsigned long long) bucket_low(i),
+                   (unsigned long long) bucket_high(i), latency->buckets[i]);
+        }
+    }
+}
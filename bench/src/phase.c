@@ -0,0 +1,38 @@
+#include <stdio.h>
+#include <utils/util.h>
+
+#include <bench/phase.h>
+
+void bench_phases_start(bench_phases_t *phases)
+{
+    phases->num_phases = 0;
+    phases->start = sel4bench_get_cycle_count();
+    phases->last = phases->start;
+}
+
+void bench_phase_end(bench_phases_t *phases, const char *name)
+{
+    ccnt_t now = sel4bench_get_cycle_count();
+    if (phases->num_phases == BENCH_MAX_PHASES) {
+        phases->phases[BENCH_MAX_PHASES - 1].cycles += now - phases->last;
+    } else {
+        phases->phases[phases->num_phases++] = (bench_phase_t) {
+            .name = name,
+            .cycles = now - phases->last,
+        };
+    }
+    phases->last = now;
+}
+
+void bench_phases_print(const char *name, const bench_phases_t *phases)
+{
+    ccnt_t total = phases->last - phases->start;
+    printf("%s: %zu phases in %llu cycles\n", name, phases->num_phases, (unsigned long long) total);
+    for (size_t i = 0; i < phases->num_phases; i++) {
+        const bench_phase_t *phase = &phases->phases[i];
+        /* in tenths of a percent */
+        unsigned long long share = total == 0 ? 0 : (unsigned long long) phase->cycles * 1000 / total;
+        printf("%s:   %-24s %12llu %3llu.%llu%%\n", name, phase->name, (unsigned long long) phase->cycles,
+               share / 10, share % 10);
+    }
+}
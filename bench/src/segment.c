@@ -0,0 +1,85 @@
+#include <autoconf.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <sel4/sel4.h>
+#include <vka/object.h>
+#include <vka/capops.h>
+#include <utils/util.h>
+#include <sel4utils/sel4_zf_logif.h>
+
+#include <bench/segment.h>
+
+void bench_segment_configure_process(sel4utils_process_t *process, vka_t *vka, vspace_t *vspace,
+                                     sel4utils_process_config_t config)
+{
+    /* only reserve the segments' regions in the new vspace, we fill them */
+    config.do_elf_load = false;
+    int error = sel4utils_configure_process_custom(process, vka, vspace, config);
+    ZF_LOGF_IFERR(error, "Failed to configure a process from %s", config.image_name);
+}
+
+/* fill the fresh frames caps[0..num), which will be mapped at vstart, from the
+ * len bytes at data that belong at data_vaddr */
+static void fill_frames(vka_t *vka, vspace_t *vspace, seL4_CPtr *caps, uintptr_t *cookies, size_t num,
+                        uintptr_t vstart, uintptr_t data_vaddr, const char *data, size_t len)
+{
+    for (size_t p = 0; p < num; p++) {
+        vka_object_t frame;
+        int error = vka_alloc_frame(vka, seL4_PageBits, &frame);
+        ZF_LOGF_IFERR(error, "Failed to allocate frame %zu of %zu", p, num);
+        caps[p] = frame.cptr;
+        cookies[p] = frame.ut;
+    }
+    char *copy = vspace_map_pages(vspace, caps, NULL, seL4_AllRights, num, seL4_PageBits, 1);
+    ZF_LOGF_IF(copy == NULL, "Failed to map %zu frames to fill", num);
+
+    memset(copy, 0, num << seL4_PageBits);
+    uintptr_t from = MAX(data_vaddr, vstart);
+    uintptr_t to = MIN(data_vaddr + len, vstart + (num << seL4_PageBits));
+    if (from < to) {
+        memcpy(copy + (from - vstart), data + (from - data_vaddr), to - from);
+    }
+#ifdef CONFIG_ARCH_ARM
+    /* written through the data cache, but may be fetched through the
+     * instruction cache */
+    for (size_t p = 0; p < num; p++) {
+        int error = seL4_ARM_Page_Unify_Instruction(caps[p], 0, BIT(seL4_PageBits));
+        ZF_LOGF_IFERR(error, "Failed to clean filled frame");
+    }
+#endif
+    vspace_unmap_pages(vspace, copy, num, seL4_PageBits, VSPACE_PRESERVE);
+}
+
+void bench_segment_map(sel4utils_process_t *process, sel4utils_elf_region_t *region, vka_t *vka,
+                       vspace_t *vspace, uintptr_t vstart, size_t num, const seL4_CPtr *shared,
+                       size_t num_shared, uintptr_t data_vaddr, const void *data, size_t len)
+{
+    seL4_CPtr *caps = malloc(num * sizeof(seL4_CPtr));
+    uintptr_t *cookies = calloc(num, sizeof(uintptr_t));
+    ZF_LOGF_IF(caps == NULL || cookies == NULL, "Failed to allocate frame caps");
+
+    for (size_t p = 0; p < num_shared; p++) {
+        cspacepath_t src, dest;
+        vka_cspace_make_path(vka, shared[p], &src);
+        int error = vka_cspace_alloc_path(vka, &dest);
+        ZF_LOGF_IFERR(error, "Failed to allocate a slot for a shared frame");
+        error = vka_cnode_copy(&dest, &src, seL4_AllRights);
+        ZF_LOGF_IFERR(error, "Failed to copy a shared frame cap");
+        caps[p] = dest.capPtr;
+    }
+    if (num_shared < num) {
+        fill_frames(vka, vspace, caps + num_shared, cookies + num_shared, num - num_shared,
+                    vstart + (num_shared << seL4_PageBits), data_vaddr, data, len);
+    }
+
+    /* the reservation carries the rights the segment asks for, and the zero
+     * cookies of the shared pages keep their frames when the process is
+     * destroyed */
+    int error = vspace_map_pages_at_vaddr(&process->vspace, caps, cookies, (void *) vstart, num,
+                                          seL4_PageBits, region->reservation);
+    ZF_LOGF_IFERR(error, "Failed to map segment at %p", (void *) vstart);
+    free(caps);
+    free(cookies);
+}
@@ -0,0 +1,63 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <utils/util.h>
+
+#include <bench/stats.h>
+
+static int compare_ccnt(const void *a, const void *b)
+{
+    ccnt_t x = *(const ccnt_t *)a;
+    ccnt_t y = *(const ccnt_t *)b;
+    return (x > y) - (x < y);
+}
+
+void bench_stats(ccnt_t *samples, size_t n, bench_stats_t *stats)
+{
+    *stats = (bench_stats_t) {.n = n};
+    if (n == 0) {
+        return;
+    }
+
+    qsort(samples, n, sizeof(ccnt_t), compare_ccnt);
+
+    ccnt_t sum = 0;
+    for (size_t i = 0; i < n; i++) {
+        sum += samples[i];
+    }
+    stats->min = samples[0];
+    stats->median = samples[n / 2];
+    stats->p99 = samples[(n * 99) / 100];
+    stats->max = samples[n - 1];
+    stats->mean = sum / n;
+}
+
+void bench_stats_print_header(void)
+{
+    printf("%-32s %8s %8s %8s %8s %8s  histogram (min..p99, >p99)\n",
+           "name", "min", "median", "p99", "max", "mean");
+}
+
+void bench_stats_print(const char *name, ccnt_t *samples, size_t n)
+{
+    bench_stats_t stats;
+    bench_stats(samples, n, &stats);
+
+    printf("%-32s %8llu %8llu %8llu %8llu %8llu  |", name,
+           (unsigned long long) stats.min, (unsigned long long) stats.median,
+           (unsigned long long) stats.p99, (unsigned long long) stats.max,
+           (unsigned long long) stats.mean);
+
+    size_t buckets[BENCH_HIST_BUCKETS + 1] = {0};
+    ccnt_t width = DIV_ROUND_UP(stats.p99 - stats.min + 1, BENCH_HIST_BUCKETS);
+    for (size_t i = 0; i < n; i++) {
+        if (samples[i] > stats.p99) {
+            buckets[BENCH_HIST_BUCKETS]++;
+        } else {
+            buckets[(samples[i] - stats.min) / width]++;
+        }
+    }
+    for (int i = 0; i <= BENCH_HIST_BUCKETS; i++) {
+        printf(" %zu", buckets[i]);
+    }
+    printf(" |\n");
+}
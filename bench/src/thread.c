@@ -0,0 +1,44 @@
+#include <sel4/sel4.h>
+#include <sel4runtime.h>
+#include <utils/util.h>
+#include <sel4utils/util.h>
+#include <sel4utils/helpers.h>
+
+#include <bench/thread.h>
+
+void bench_thread_create(bench_thread_t *thread, seL4_CPtr untyped, seL4_CPtr cnode,
+                         seL4_CPtr vspace, seL4_CPtr auth_tcb, seL4_Word prio)
+{
+    seL4_Error error = seL4_Untyped_Retype(untyped, seL4_TCBObject, seL4_TCBBits, cnode, 0, 0, thread->tcb, 1);
+    ZF_LOGF_IFERR(error, "Failed to retype thread");
+
+    error = seL4_TCB_Configure(thread->tcb, seL4_CapNull, cnode, 0, vspace, 0,
+                               (seL4_Word) thread->ipc_buf, thread->ipc_frame);
+    ZF_LOGF_IFERR(error, "Failed to configure thread");
+
+    error = seL4_TCB_SetPriority(thread->tcb, auth_tcb, prio);
+    ZF_LOGF_IFERR(error, "Failed to set thread priority");
+
+    /* the ipc buffer is found through TLS */
+    uintptr_t tls = sel4runtime_write_tls_image(thread->tls_region);
+    error = sel4runtime_set_tls_variable(tls, __sel4_ipc_buffer, thread->ipc_buf);
+    ZF_LOGF_IF(error, "Failed to set ipc buffer in TLS of thread");
+    error = seL4_TCB_SetTLSBase(thread->tcb, tls);
+    ZF_LOGF_IFERR(error, "Failed to set TLS base");
+}
+
+void bench_thread_start(bench_thread_t *thread, seL4_Word core, void *fn, void *arg0, void *arg1)
+{
+    seL4_Error error;
+#if CONFIG_MAX_NUM_NODES > 1
+    error = seL4_TCB_SetAffinity(thread->tcb, core);
+    ZF_LOGF_IFERR(error, "Failed to set thread affinity");
+#endif
+
+    seL4_UserContext regs = {0};
+    error = sel4utils_arch_init_local_context(fn, arg0, arg1, NULL, (void *) thread->stack_top, &regs);
+    ZF_LOGF_IFERR(error, "Failed to initialise thread context");
+    /* write the registers and resume the thread in one invocation */
+    error = seL4_TCB_WriteRegisters(thread->tcb, 1, 0, sizeof(regs) / sizeof(seL4_Word), &regs);
+    ZF_LOGF_IFERR(error, "Failed to start thread");
+}
@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <sel4/sel4.h>
+#include <utils/util.h>
+
+#include "cslot.h"
+
+#define BIT64(n) (1ull << (n))
+
+static void bitmap_set(cslot_t *cs, int node, seL4_Word slot)
+{
+    cslot_bitmap_t *bitmap = &cs->nodes[node];
+    bitmap->words[slot / 64] |= BIT64(slot % 64);
+    bitmap->summary |= BIT64(slot / 64);
+    cs->nonempty |= BIT64(node);
+}
+
+void cslot_init(cslot_t *cs, seL4_BootInfo *info, seL4_CPtr untyped)
+{
+    ZF_LOGF_IF(info->initThreadCNodeSizeBits != CSLOT_NODE_BITS,
+               "Initial CNode is 2^%lu slots, not 2^%d", (unsigned long) info->initThreadCNodeSizeBits,
+               CSLOT_NODE_BITS);
+    *cs = (cslot_t) {
+        .untyped = untyped,
+        .root = seL4_CapInitThreadCNode,
+        .num_nodes = 1,
+    };
+    for (seL4_CPtr slot = info->empty.start; slot < info->empty.end; slot++) {
+        bitmap_set(cs, 0, slot);
+    }
+    /* keep what growing will need before anything else can take it */
+    cs->level1 = cslot_alloc(cs);
+    cs->scratch = cslot_alloc(cs);
+    ZF_LOGF_IF(cs->scratch == seL4_CapNull, "No empty slots in the initial CNode");
+}
+
+/* make the level 1 CNode the root of the CSpace, with the initial CNode in
+ * its slot 0 */
+static int make_two_level(cslot_t *cs)
+{
+    seL4_Error error = seL4_Untyped_Retype(cs->untyped, seL4_CNodeObject, CSLOT_LEVEL1_BITS,
+                                           seL4_CapInitThreadCNode, 0, 0, cs->scratch, 1);
+    if (error != seL4_NoError) {
+        ZF_LOGE("Failed to retype the level 1 CNode (%d)", error);
+        return -1;
+    }
+
+    /* the guard skips the bits above both levels, so looking up a CPtr
+     * through the level 1 cap takes all of seL4_WordBits */
+    seL4_Word guard = seL4_CNode_CapData_new(0, seL4_WordBits - CSLOT_LEVEL1_BITS - CSLOT_NODE_BITS).words[0];
+    error = seL4_CNode_Mutate(seL4_CapInitThreadCNode, cs->level1, seL4_WordBits,
+                              seL4_CapInitThreadCNode, cs->scratch, seL4_WordBits, guard);
+    ZF_LOGF_IF(error != seL4_NoError, "Failed to set the guard of the level 1 CNode");
+    cslot_free(cs, cs->scratch);
+
+    /* the initial CNode below it consumes the last CSLOT_NODE_BITS, so needs
+     * no guard of its own */
+    error = seL4_CNode_Mint(cs->level1, 0, seL4_WordBits - CSLOT_NODE_BITS,
+                            seL4_CapInitThreadCNode, seL4_CapInitThreadCNode, seL4_WordBits,
+                            seL4_AllRights, seL4_CNode_CapData_new(0, 0).words[0]);
+    ZF_LOGF_IF(error != seL4_NoError, "Failed to put the initial CNode in the level 1 CNode");
+
+    error = seL4_TCB_SetSpace(seL4_CapInitThreadTCB, seL4_CapNull, cs->level1, guard,
+                              seL4_CapInitThreadVSpace, 0);
+    ZF_LOGF_IF(error != seL4_NoError, "Failed to make the level 1 CNode the CSpace root");
+
+    cs->root = cs->level1;
+    return 0;
+}
+
+/* add a CNode of free slots to the CSpace */
+static int grow(cslot_t *cs)
+{
+    if (cs->num_nodes == CSLOT_MAX_NODES) {
+        ZF_LOGE("The CSpace already has %d CNodes", cs->num_nodes);
+        return -1;
+    }
+    if (cs->num_nodes == 1 && make_two_level(cs) != 0) {
+        return -1;
+    }
+
+    /* straight into the level 1 CNode, which is the root of the lookup */
+    seL4_Error error = seL4_Untyped_Retype(cs->untyped, seL4_CNodeObject, CSLOT_NODE_BITS,
+                                           cs->level1, 0, 0, cs->num_nodes, 1);
+    if (error != seL4_NoError) {
+        ZF_LOGE("Failed to retype CNode %d (%d)", cs->num_nodes, error);
+        return -1;
+    }
+
+    int node = cs->num_nodes++;
+    cslot_bitmap_t *bitmap = &cs->nodes[node];
+    for (size_t i = 0; i < ARRAY_SIZE(bitmap->words); i++) {
+        bitmap->words[i] = ~0ull;
+    }
+    /* a summary bit for each of the 64 words */
+    bitmap->summary = ~0ull;
+    cs->nonempty |= BIT64(node);
+    return 0;
+}
+
+seL4_CPtr cslot_alloc(cslot_t *cs)
+{
+    if (cs->nonempty == 0 && grow(cs) != 0) {
+        return seL4_CapNull;
+    }
+    int node = CTZLL(cs->nonempty);
+    cslot_bitmap_t *bitmap = &cs->nodes[node];
+    int word = CTZLL(bitmap->summary);
+    int bit = CTZLL(bitmap->words[word]);
+
+    bitmap->words[word] &= ~BIT64(bit);
+    if (bitmap->words[word] == 0) {
+        bitmap->summary &= ~BIT64(word);
+        if (bitmap->summary == 0) {
+            cs->nonempty &= ~BIT64(node);
+        }
+    }
+    return ((seL4_CPtr) node << CSLOT_NODE_BITS) | (word * 64 + bit);
+}
+
+void cslot_free(cslot_t *cs, seL4_CPtr slot)
+{
+    seL4_Word node = slot >> CSLOT_NODE_BITS;
+    seL4_Word index = slot & MASK(CSLOT_NODE_BITS);
+    ZF_LOGF_IF(node >= (seL4_Word) cs->num_nodes, "Slot %lu is not in the CSpace", (unsigned long) slot);
+    ZF_LOGF_IF(cs->nodes[node].words[index / 64] & BIT64(index % 64), "Slot %lu is already free",
+               (unsigned long) slot);
+    bitmap_set(cs, node, index);
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdint.h>
+#include <sel4/sel4.h>
+#include <utils/util.h>
+
+/*
+ * A CSlot allocator for the root task that can grow its CSpace past the
+ * initial CNode.
+ *
+ * Free slots are tracked per CNode in a two-level bitmap: a bit per slot,
+ * and a summary word with a bit per bitmap word that has any free. A third
+ * word has a bit per CNode with any free slots. Allocating a slot is three
+ * find-first-set operations, and freeing one is setting three bits.
+ *
+ * To start with, the allocator hands out the empty slots of the initial
+ * CNode. When they run out, it retypes a level 1 CNode, puts a copy of the
+ * initial CNode with no guard in its slot 0, and makes it the root of the
+ * CSpace, with a guard that covers the bits above both levels. Every CPtr
+ * into the initial CNode resolves to the same slot as before, and each
+ * further CNode, retyped into the next slot of the level 1 CNode, adds the
+ * CPtrs (index << CSLOT_NODE_BITS) + slot.
+ *
+ * Once the CSpace has grown, new slots must be addressed through
+ * cslot_root: seL4_CapInitThreadCNode still reaches only the initial CNode.
+ */
+
+/* slots in each CNode, which must be the size of the initial CNode too */
+#define CSLOT_NODE_BITS 12
+/* slots in the level 1 CNode, and so the most CNodes */
+#define CSLOT_LEVEL1_BITS 6
+#define CSLOT_MAX_NODES BIT(CSLOT_LEVEL1_BITS)
+
+/* bits of free slots in a CNode */
+typedef struct {
+    /* bit i set if words[i] is not 0 */
+    uint64_t summary;
+    /* bit set for a free slot */
+    uint64_t words[BIT(CSLOT_NODE_BITS) / 64];
+} cslot_bitmap_t;
+
+typedef struct {
+    /* the untyped new CNodes are retyped from */
+    seL4_CPtr untyped;
+    /* CNode to address slots through, at depth seL4_WordBits */
+    seL4_CPtr root;
+    /* slot in the initial CNode for the level 1 CNode, and one to build it
+     * in, given back once it is built */
+    seL4_CPtr level1;
+    seL4_CPtr scratch;
+    int num_nodes;
+    /* bit i set if nodes[i] has any free slots */
+    uint64_t nonempty;
+    cslot_bitmap_t nodes[CSLOT_MAX_NODES];
+} cslot_t;
+
+/* manage the empty slots in info, growing the CSpace with CNodes retyped
+ * from untyped when they run out */
+void cslot_init(cslot_t *cs, seL4_BootInfo *info, seL4_CPtr untyped);
+
+/* a free slot, or seL4_CapNull if there are none and the CSpace cannot grow */
+seL4_CPtr cslot_alloc(cslot_t *cs);
+
+/* make slot, which must be empty, free again */
+void cslot_free(cslot_t *cs, seL4_CPtr slot);
+
+/* the CNode cap through which every slot from cslot_alloc resolves */
+static inline seL4_CPtr cslot_root(cslot_t *cs)
+{
+    return cs->root;
+}
@@ -4,6 +4,48 @@
 #include <sel4platsupport/bootinfo.h>
 #include <utils/util.h>
 
+#include "cslot.h"
+
+// more slots than the initial CNode has
+#define NUM_COPIES 6000
+
+// copy the TCB cap into NUM_COPIES slots from a cslot allocator, so that the
+// CSpace has to grow, and check the last copy works
+static void fill_cspace(seL4_BootInfo *info)
+{
+    static cslot_t cs;
+    static seL4_CPtr copies[NUM_COPIES];
+
+    // an untyped for the level 1 CNode and a few 4096 slot CNodes
+    seL4_CPtr untyped = seL4_CapNull;
+    for (seL4_CPtr slot = info->untyped.start; slot != info->untyped.end; slot++) {
+        seL4_UntypedDesc *desc = &info->untypedList[slot - info->untyped.start];
+        if (!desc->isDevice && desc->sizeBits >= CSLOT_NODE_BITS + seL4_SlotBits + 2) {
+            untyped = slot;
+            break;
+        }
+    }
+    ZF_LOGF_IF(untyped == seL4_CapNull, "No untyped big enough for the CNodes");
+    cslot_init(&cs, info, untyped);
+
+    for (int i = 0; i < NUM_COPIES; i++) {
+        copies[i] = cslot_alloc(&cs);
+        ZF_LOGF_IF(copies[i] == seL4_CapNull, "Failed to allocate slot %d", i);
+        seL4_Error error = seL4_CNode_Copy(cslot_root(&cs), copies[i], seL4_WordBits,
+                                           seL4_CapInitThreadCNode, seL4_CapInitThreadTCB, seL4_WordBits,
+                                           seL4_AllRights);
+        ZF_LOGF_IF(error, "Failed to copy cap to slot %d", i);
+    }
+    printf("Copied the TCB cap to %d slots over %d CNodes, the last in slot %#lx\n", NUM_COPIES,
+           cs.num_nodes, (unsigned long) copies[NUM_COPIES - 1]);
+    seL4_Error error = seL4_TCB_SetPriority(copies[NUM_COPIES - 1], copies[NUM_COPIES - 1], 10);
+    ZF_LOGF_IF(error, "Failed to set priority through the last copy");
+
+    for (int i = 0; i < NUM_COPIES; i++) {
+        seL4_CNode_Delete(cslot_root(&cs), copies[i], seL4_WordBits);
+        cslot_free(&cs, copies[i]);
+    }
+}
 
 int main(int argc, char *argv[]) {
     
@@ -43,6 +85,8 @@ int main(int argc, char *argv[]) {
                             seL4_CapInitThreadCNode, last_slot, seL4_WordBits);
     ZF_LOGF_IF(error != seL4_FailedLookup, "last_slot is not empty");
 
+    fill_cspace(info);
+
     printf("Suspending current thread\n");
     // TODO suspend the current thread
     seL4_TCB_Suspend(seL4_CapInitThreadTCB);
@@ -38,6 +38,8 @@
 #include <sel4utils/thread.h>
 
 #include <sel4platsupport/bootinfo.h>
+#include <sel4bench/sel4bench.h>
+#include <bench/phase.h>
 
 /* global environment variables */
 
@@ -53,6 +55,9 @@ vka_t vka;
 /* allocman_t defined in allocman.h */
 allocman_t *allocman;
 
+/* how long each step of bringing up the environment takes */
+static bench_phases_t boot;
+
 /* static memory for the allocator to bootstrap with */
 #define ALLOCATOR_STATIC_POOL_SIZE (BIT(seL4_PageBits) * 10)
 UNUSED static char allocator_mem_pool[ALLOCATOR_STATIC_POOL_SIZE];
@@ -72,15 +77,22 @@ void thread_2(void)
 int main(void)
 {
     UNUSED int error = 0;
+    sel4bench_init();
+    bench_phases_start(&boot);
     /* TASK 1: get boot info */
     info = platsupport_get_bootinfo();
     ZF_LOGF_IF(info == NULL, "Failed to get bootinfo.");
+    bench_phase_end(&boot, "bootinfo");
     zf_log_set_tag_prefix("dynamic-1:");
     NAME_THREAD(seL4_CapInitThreadTCB, "dynamic-1");
     /* TASK 2: initialise simple object */
     simple_default_init_bootinfo(&simple, info);
+    bench_phase_end(&boot, "simple");
+#ifndef BOOT_QUIET
     /* TASK 3: print out bootinfo and other info about simple */
     simple_print(&simple);
+    bench_phase_end(&boot, "simple_print");
+#endif
     /* TASK 4: create an allocator */
     allocman = bootstrap_use_current_simple(&simple, ALLOCATOR_STATIC_POOL_SIZE, allocator_mem_pool);
 
@@ -89,6 +101,7 @@ int main(void)
                                  "\tMemory pool pointer valid?\n");
     /* TASK 5: create a vka (interface for interacting with the underlying allocator) */
     allocman_make_vka(&vka, allocman);
+    bench_phase_end(&boot, "allocator");
 
     /* TASK 6: get our cspace root cnode */
     seL4_CPtr cspace_cap;
@@ -132,6 +145,8 @@ int main(void)
     /* TASK 14: start the new thread running */
     error = seL4_TCB_Resume(tcb_object.cptr);
     ZF_LOGF_IFERR(error, "Failed to start new thread.\n");
+    bench_phase_end(&boot, "thread");
+    bench_phases_print("dynamic-1: boot", &boot);
     /* we are done, say hello */
     printf("main: hello world\n");
     return 0;
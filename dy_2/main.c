@@ -45,6 +45,12 @@
 #include <sel4utils/sel4_zf_logif.h>
 
 #include <sel4platsupport/bootinfo.h>
+#include <sel4bench/sel4bench.h>
+#include <bench/phase.h>
+#include <bench/latency.h>
+
+#include "slab.h"
+#include "warm.h"
 
 /* constants */
 #define IPCBUF_FRAME_SIZE_BITS 12 // use a 4K frame for the IPC buffer
@@ -59,6 +65,9 @@ simple_t simple;
 vka_t vka;
 allocman_t *allocman;
 
+/* how long each step of bringing up the environment takes */
+static bench_phases_t boot;
+
 /* variables shared with second thread */
 vka_object_t ep_object;
 cspacepath_t ep_cap_path;
@@ -77,6 +86,147 @@ static char tls_region[CONFIG_SEL4RUNTIME_STATIC_TLS] = {};
 /* convenience function */
 extern void name_thread(seL4_CPtr tcb, char *name);
 
+/* objects of each type allocated each way by slab_benchmark, and the batches
+ * the slabs create them in. The allocator's metadata lives in its small
+ * static pool, which bounds how many objects it can track at once. */
+#define SLAB_OBJECTS 64
+#define SLAB_BATCH_BITS 5
+
+/* allocate SLAB_OBJECTS objects of type from vka and then from a slab, and
+ * print the cycles per allocation each way. Everything is given back before
+ * returning. */
+static void slab_benchmark(const char *name, seL4_Word type, seL4_Word size_bits)
+{
+    static vka_object_t objects[SLAB_OBJECTS];
+    ccnt_t start = sel4bench_get_cycle_count();
+    for (int i = 0; i < SLAB_OBJECTS; i++) {
+        int error = vka_alloc_object(&vka, type, size_bits, &objects[i]);
+        ZF_LOGF_IFERR(error, "Failed to allocate %s %d from vka", name, i);
+    }
+    ccnt_t allocman_cycles = sel4bench_get_cycle_count() - start;
+    for (int i = 0; i < SLAB_OBJECTS; i++) {
+        vka_free_object(&vka, &objects[i]);
+    }
+
+    static seL4_CPtr slab_objects[SLAB_OBJECTS];
+    slab_t slab;
+    slab_init(&slab, &vka, type, size_bits, SLAB_BATCH_BITS);
+    start = sel4bench_get_cycle_count();
+    for (int i = 0; i < SLAB_OBJECTS; i++) {
+        slab_objects[i] = slab_alloc(&slab);
+        ZF_LOGF_IF(slab_objects[i] == seL4_CapNull, "Failed to allocate %s %d from a slab", name, i);
+    }
+    ccnt_t slab_cycles = sel4bench_get_cycle_count() - start;
+    for (int i = 0; i < SLAB_OBJECTS; i++) {
+        slab_free(&slab, slab_objects[i]);
+    }
+    slab_destroy(&slab);
+
+    printf("slab: %d %s: %llu cycles each from allocman, %llu from a slab of batches of %lu\n",
+           SLAB_OBJECTS, name, (unsigned long long) allocman_cycles / SLAB_OBJECTS,
+           (unsigned long long) slab_cycles / SLAB_OBJECTS, (unsigned long) BIT(SLAB_BATCH_BITS));
+}
+
+/* requests made by warm_benchmark, and the frames each allocates */
+#define WARM_REQUESTS 16
+#define WARM_FRAMES 4
+/* watermarks of the warm pool of frames */
+#define WARM_LOW 8
+#define WARM_HIGH 16
+
+/* IPC buffer of the refill thread, next to thread_2's in the same page table */
+#define REFILL_IPCBUF_VADDR (IPCBUF_VADDR + BIT(IPCBUF_FRAME_SIZE_BITS))
+
+/* stack and tls region for the refill thread */
+#define REFILL_STACK_SIZE 1024
+static uint64_t refill_stack[REFILL_STACK_SIZE];
+static char refill_tls_region[CONFIG_SEL4RUNTIME_STATIC_TLS] = {};
+
+/* frames kept ready by the refill thread */
+static warm_pool_t frame_pool;
+
+/* function to run in the refill thread */
+void refill_thread(void)
+{
+    warm_pool_refill(&frame_pool);
+}
+
+/* start the refill thread. New TCBs run at priority 0, below us, so it only
+ * runs while we are blocked. */
+static void start_refill_thread(seL4_CPtr cspace_cap, seL4_CPtr pd_cap)
+{
+    vka_object_t tcb_object;
+    int error = vka_alloc_tcb(&vka, &tcb_object);
+    ZF_LOGF_IFERR(error, "Failed to allocate the refill thread's TCB");
+
+    vka_object_t ipc_frame_object;
+    error = vka_alloc_frame(&vka, IPCBUF_FRAME_SIZE_BITS, &ipc_frame_object);
+    ZF_LOGF_IFERR(error, "Failed to allocate the refill thread's IPC buffer");
+    error = seL4_ARCH_Page_Map(ipc_frame_object.cptr, pd_cap, REFILL_IPCBUF_VADDR, seL4_AllRights,
+                               seL4_ARCH_Default_VMAttributes);
+    ZF_LOGF_IFERR(error, "Failed to map the refill thread's IPC buffer");
+
+    error = seL4_TCB_Configure(tcb_object.cptr, seL4_CapNull,
+                               cspace_cap, seL4_NilData, pd_cap, seL4_NilData,
+                               REFILL_IPCBUF_VADDR, ipc_frame_object.cptr);
+    ZF_LOGF_IFERR(error, "Failed to configure the refill thread");
+    name_thread(tcb_object.cptr, "dynamic-2: refill");
+
+    seL4_UserContext regs = {0};
+    sel4utils_set_instruction_pointer(&regs, (seL4_Word)refill_thread);
+    sel4utils_set_stack_pointer(&regs, (uintptr_t)refill_stack + sizeof(refill_stack));
+    error = seL4_TCB_WriteRegisters(tcb_object.cptr, 0, 0, sizeof(seL4_UserContext) / sizeof(seL4_Word), &regs);
+    ZF_LOGF_IFERR(error, "Failed to write the refill thread's registers");
+
+    uintptr_t tls = sel4runtime_write_tls_image(refill_tls_region);
+    error = sel4runtime_set_tls_variable(tls, __sel4_ipc_buffer, (seL4_IPCBuffer *)REFILL_IPCBUF_VADDR);
+    ZF_LOGF_IF(error, "Failed to set ipc buffer in TLS of the refill thread");
+    error = seL4_TCB_SetTLSBase(tcb_object.cptr, tls);
+    ZF_LOGF_IF(error, "Failed to set TLS base of the refill thread");
+
+    error = seL4_TCB_Resume(tcb_object.cptr);
+    ZF_LOGF_IFERR(error, "Failed to start the refill thread");
+}
+
+/* make WARM_REQUESTS requests that each allocate WARM_FRAMES frames, first
+ * from the vka and then from a pool kept warm by the refill thread, and
+ * print the latency of each allocation both ways */
+static void warm_benchmark(seL4_CPtr cspace_cap, seL4_CPtr pd_cap)
+{
+    static vka_object_t frames[WARM_REQUESTS * WARM_FRAMES];
+    static bench_latency_t inline_latency, warm_latency;
+    bench_latency_init(&inline_latency);
+    bench_latency_init(&warm_latency);
+
+    for (int i = 0; i < WARM_REQUESTS * WARM_FRAMES; i++) {
+        ccnt_t start = sel4bench_get_cycle_count();
+        int error = vka_alloc_object(&vka, seL4_ARCH_4KPage, seL4_PageBits, &frames[i]);
+        bench_latency_record(&inline_latency, start, sel4bench_get_cycle_count());
+        ZF_LOGF_IFERR(error, "Failed to allocate frame %d from vka", i);
+    }
+    for (int i = 0; i < WARM_REQUESTS * WARM_FRAMES; i++) {
+        vka_free_object(&vka, &frames[i]);
+    }
+
+    warm_pool_init(&frame_pool, &vka, seL4_ARCH_4KPage, seL4_PageBits, WARM_LOW, WARM_HIGH);
+    start_refill_thread(cspace_cap, pd_cap);
+    for (int i = 0; i < WARM_REQUESTS; i++) {
+        for (int j = 0; j < WARM_FRAMES; j++) {
+            ccnt_t start = sel4bench_get_cycle_count();
+            int error = warm_pool_alloc(&frame_pool, &frames[i * WARM_FRAMES + j]);
+            bench_latency_record(&warm_latency, start, sel4bench_get_cycle_count());
+            ZF_LOGF_IFERR(error, "Failed to allocate frame %d from the warm pool", i * WARM_FRAMES + j);
+        }
+        /* between requests, which is when the refill thread gets to run */
+        warm_pool_idle(&frame_pool);
+    }
+
+    bench_latency_print("warm: frames from vka", "cycles", &inline_latency, false);
+    bench_latency_print("warm: frames from a warm pool", "cycles", &warm_latency, false);
+    printf("warm: %llu of %d allocations found the pool empty\n", (unsigned long long) frame_pool.misses,
+           WARM_REQUESTS * WARM_FRAMES);
+}
+
 /* function to run in the new thread */
 void thread_2(void)
 {
@@ -105,19 +255,26 @@ void thread_2(void)
 int main(void)
 {
     UNUSED int error;
+    sel4bench_init();
+    bench_phases_start(&boot);
 
     /* get boot info */
     info = platsupport_get_bootinfo();
     ZF_LOGF_IF(info == NULL, "Failed to get bootinfo.");
+    bench_phase_end(&boot, "bootinfo");
     /* Set up logging and give us a name: useful for debugging if the thread faults */
     zf_log_set_tag_prefix("dynamic-2:");
     name_thread(seL4_CapInitThreadTCB, "dynamic-2");
 
     /* init simple */
     simple_default_init_bootinfo(&simple, info);
+    bench_phase_end(&boot, "simple");
 
+#ifndef BOOT_QUIET
     /* print out bootinfo and other info about simple */
     simple_print(&simple);
+    bench_phase_end(&boot, "simple_print");
+#endif
 
     /* create an allocator */
     allocman = bootstrap_use_current_simple(&simple, ALLOCATOR_STATIC_POOL_SIZE, allocator_mem_pool);
@@ -127,6 +284,13 @@ int main(void)
 
     /* create a vka (interface for interacting with the underlying allocator) */
     allocman_make_vka(&vka, allocman);
+    bench_phase_end(&boot, "allocator");
+
+    slab_benchmark("endpoints", seL4_EndpointObject, 0);
+    slab_benchmark("notifications", seL4_NotificationObject, 0);
+    slab_benchmark("TCBs", seL4_TCBObject, 0);
+    slab_benchmark("frames", seL4_ARCH_4KPage, seL4_PageBits);
+    bench_phase_end(&boot, "slab benchmark");
 
     /* get our cspace root cnode */
     seL4_CPtr cspace_cap;
@@ -222,6 +386,8 @@ int main(void)
     /* start the new thread running */
     error = seL4_TCB_Resume(tcb_object.cptr);
     ZF_LOGF_IFERR(error, "Failed to start new thread.\n");
+    bench_phase_end(&boot, "thread");
+    bench_phases_print("dynamic-2: boot", &boot);
 
     /* we are done, say hello */
     printf("main: hello world\n");
@@ -250,5 +416,7 @@ int main(void)
 
     printf("main: got a reply: %#" PRIxPTR "\n", msg);
 
+    warm_benchmark(cspace_cap, pd_cap);
+
     return 0;
 }
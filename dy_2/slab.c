@@ -0,0 +1,136 @@
+/*
+ * Copyright 2018, Data61
+ * Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+ * ABN 41 687 119 230.
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(DATA61_BSD)
+ */
+#include <autoconf.h>
+
+#include <stdlib.h>
+
+#include <sel4/sel4.h>
+#include <vka/object.h>
+#include <vka/capops.h>
+#include <utils/util.h>
+#include <utils/zf_log.h>
+
+#include "slab.h"
+
+void slab_init(slab_t *slab, vka_t *vka, seL4_Word type, seL4_Word size_bits, seL4_Word batch_bits)
+{
+    *slab = (slab_t) {
+        .vka = vka,
+        .type = type,
+        .size_bits = size_bits,
+        .object_bits = vka_get_object_size(type, size_bits),
+        .batch_bits = batch_bits,
+    };
+}
+
+/* put a new batch of objects on the free list */
+static int slab_refill(slab_t *slab)
+{
+    size_t batch = BIT(slab->batch_bits);
+    if (slab->capacity - slab->num_free < batch) {
+        seL4_CPtr *free = realloc(slab->free, (slab->num_free + batch) * sizeof(seL4_CPtr));
+        if (free == NULL) {
+            return -1;
+        }
+        slab->free = free;
+        slab->capacity = slab->num_free + batch;
+    }
+    vka_object_t *batches = realloc(slab->batches, (slab->num_batches + 1) * sizeof(vka_object_t));
+    if (batches == NULL) {
+        return -1;
+    }
+    slab->batches = batches;
+
+    vka_object_t untyped;
+    int error = vka_alloc_untyped(slab->vka, slab->object_bits + slab->batch_bits, &untyped);
+    if (error) {
+        ZF_LOGE("No untyped for a batch of %zu objects of type %lu", batch, (unsigned long) slab->type);
+        return error;
+    }
+
+    /* the new objects go where the free list ends */
+    seL4_CPtr *slots = slab->free + slab->num_free;
+    size_t num_slots = 0;
+    for (; num_slots < batch; num_slots++) {
+        error = vka_cspace_alloc(slab->vka, &slots[num_slots]);
+        if (error) {
+            ZF_LOGE("No slots for a batch of %zu objects", batch);
+            goto fail;
+        }
+    }
+
+    for (size_t start = 0, end; start < batch; start = end) {
+        /* the run of consecutive slots from start */
+        for (end = start + 1; end < batch && end - start < CONFIG_RETYPE_FAN_OUT_LIMIT &&
+             slots[end] == slots[end - 1] + 1; end++);
+
+        cspacepath_t path;
+        vka_cspace_make_path(slab->vka, slots[start], &path);
+        error = seL4_Untyped_Retype(untyped.cptr, slab->type, slab->size_bits, path.root, path.dest,
+                                    path.destDepth, path.offset, end - start);
+        if (error != seL4_NoError) {
+            ZF_LOGE("Failed to retype %zu objects of type %lu", end - start, (unsigned long) slab->type);
+            /* delete any objects already created */
+            cspacepath_t untyped_path;
+            vka_cspace_make_path(slab->vka, untyped.cptr, &untyped_path);
+            vka_cnode_revoke(&untyped_path);
+            goto fail;
+        }
+    }
+    slab->num_free += batch;
+    slab->batches[slab->num_batches++] = untyped;
+    return 0;
+
+fail:
+    for (size_t i = 0; i < num_slots; i++) {
+        vka_cspace_free(slab->vka, slots[i]);
+    }
+    vka_free_object(slab->vka, &untyped);
+    return -1;
+}
+
+seL4_CPtr slab_alloc(slab_t *slab)
+{
+    if (slab->num_free == 0 && slab_refill(slab) != 0) {
+        return seL4_CapNull;
+    }
+    return slab->free[--slab->num_free];
+}
+
+void slab_free(slab_t *slab, seL4_CPtr object)
+{
+    /* never more than were created, which the list has had room for */
+    ZF_LOGF_IF(slab->num_free == slab->capacity, "Freed an object not from the slab");
+    slab->free[slab->num_free++] = object;
+}
+
+void slab_destroy(slab_t *slab)
+{
+    ZF_LOGF_IF(slab->num_free != slab->num_batches * BIT(slab->batch_bits),
+               "Destroyed a slab with objects still allocated");
+
+    /* revoking each untyped deletes the objects created from it, leaving
+     * their slots empty */
+    for (size_t i = 0; i < slab->num_batches; i++) {
+        cspacepath_t path;
+        vka_cspace_make_path(slab->vka, slab->batches[i].cptr, &path);
+        int error = vka_cnode_revoke(&path);
+        ZF_LOGF_IF(error, "Failed to revoke a batch of objects");
+        vka_free_object(slab->vka, &slab->batches[i]);
+    }
+    for (size_t i = 0; i < slab->num_free; i++) {
+        vka_cspace_free(slab->vka, slab->free[i]);
+    }
+    free(slab->free);
+    free(slab->batches);
+    *slab = (slab_t) {0};
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright 2018, Data61
+ * Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+ * ABN 41 687 119 230.
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(DATA61_BSD)
+ */
+#pragma once
+
+#include <stddef.h>
+
+#include <sel4/sel4.h>
+#include <vka/vka.h>
+
+/*
+ * Kernel objects of one type, created in batches in front of a vka.
+ *
+ * When it runs out, a slab takes an untyped big enough for a batch of
+ * objects from the vka, and a slot for each. A single seL4_Untyped_Retype
+ * then creates the batch into each run of consecutive slots, which is
+ * normally all of them. Objects are handed out from, and freed back to, a
+ * free list.
+ *
+ * Freed objects are reused as they are, not revoked and recreated, so the
+ * caller must leave them clean: no caps derived from them, frames unmapped,
+ * TCBs suspended. A slab only gives memory back to the vka when it is
+ * destroyed, once every object has been freed back to it.
+ */
+
+typedef struct {
+    vka_t *vka;
+    seL4_Word type;
+    seL4_Word size_bits;
+    /* size of each object, and of each batch, as powers of two */
+    seL4_Word object_bits;
+    seL4_Word batch_bits;
+    /* free objects, used as a stack */
+    seL4_CPtr *free;
+    size_t num_free;
+    size_t capacity;
+    /* the untyped each batch was created from */
+    vka_object_t *batches;
+    size_t num_batches;
+} slab_t;
+
+/* a slab of objects of type and size_bits, as for vka_alloc_object,
+ * created BIT(batch_bits) at a time */
+void slab_init(slab_t *slab, vka_t *vka, seL4_Word type, seL4_Word size_bits, seL4_Word batch_bits);
+
+/* a cap to a free object, or seL4_CapNull if the vka has no memory or slots
+ * for another batch */
+seL4_CPtr slab_alloc(slab_t *slab);
+
+void slab_free(slab_t *slab, seL4_CPtr object);
+
+/* delete every object and give their slots and untyped back to the vka. All
+ * of the objects must have been freed. */
+void slab_destroy(slab_t *slab);
@@ -0,0 +1,96 @@
+/*
+ * Copyright 2018, Data61
+ * Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+ * ABN 41 687 119 230.
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(DATA61_BSD)
+ */
+#include <autoconf.h>
+
+#include <sel4/sel4.h>
+#include <vka/object.h>
+#include <utils/util.h>
+#include <utils/zf_log.h>
+
+#include "warm.h"
+
+/* so the ring indices can run on past it and wrap */
+compile_time_assert(warm_max_objects_power_of_two, IS_POWER_OF_2(WARM_MAX_OBJECTS));
+
+/* allocate objects until the pool is up to its high watermark */
+static void fill(warm_pool_t *pool)
+{
+    size_t head = pool->head;
+    while (head - __atomic_load_n(&pool->tail, __ATOMIC_ACQUIRE) < pool->high) {
+        int error = vka_alloc_object(pool->vka, pool->type, pool->size_bits,
+                                     &pool->ready[head % WARM_MAX_OBJECTS]);
+        if (error) {
+            ZF_LOGE("Failed to refill a pool of objects of type %lu", (unsigned long) pool->type);
+            return;
+        }
+        head++;
+        __atomic_store_n(&pool->head, head, __ATOMIC_RELEASE);
+    }
+}
+
+void warm_pool_init(warm_pool_t *pool, vka_t *vka, seL4_Word type, seL4_Word size_bits, size_t low,
+                    size_t high)
+{
+    ZF_LOGF_IF(low > high || high > WARM_MAX_OBJECTS, "Bad watermarks %zu and %zu", low, high);
+    *pool = (warm_pool_t) {
+        .vka = vka,
+        .type = type,
+        .size_bits = size_bits,
+        .low = low,
+        .high = high,
+    };
+    int error = vka_alloc_notification(vka, &pool->kick);
+    ZF_LOGF_IFERR(error, "Failed to allocate a notification to start refills");
+    error = vka_alloc_notification(vka, &pool->done);
+    ZF_LOGF_IFERR(error, "Failed to allocate a notification for finished refills");
+    fill(pool);
+}
+
+int warm_pool_alloc(warm_pool_t *pool, vka_object_t *result)
+{
+    size_t tail = pool->tail;
+    if (__atomic_load_n(&pool->head, __ATOMIC_ACQUIRE) == tail) {
+        pool->misses++;
+        /* finish any refill, rather than share the vka with it */
+        warm_pool_idle(pool);
+        if (pool->head == tail) {
+            return vka_alloc_object(pool->vka, pool->type, pool->size_bits, result);
+        }
+    }
+    *result = pool->ready[tail % WARM_MAX_OBJECTS];
+    tail++;
+    __atomic_store_n(&pool->tail, tail, __ATOMIC_RELEASE);
+    if (__atomic_load_n(&pool->head, __ATOMIC_ACQUIRE) - tail < pool->low && !pool->kicked) {
+        /* the refill thread is lower priority, so it waits to run until we
+         * block */
+        pool->kicked = true;
+        seL4_Signal(pool->kick.cptr);
+    }
+    return 0;
+}
+
+void warm_pool_idle(warm_pool_t *pool)
+{
+    if (pool->kicked) {
+        seL4_Wait(pool->done.cptr, NULL);
+        pool->kicked = false;
+    }
+}
+
+void warm_pool_refill(warm_pool_t *pool)
+{
+    while (1) {
+        seL4_Wait(pool->kick.cptr, NULL);
+        fill(pool);
+        seL4_Signal(pool->done.cptr);
+    }
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright 2018, Data61
+ * Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+ * ABN 41 687 119 230.
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(DATA61_BSD)
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <sel4/sel4.h>
+#include <vka/vka.h>
+#include <vka/object.h>
+
+/*
+ * Objects of one type allocated from a vka ahead of demand.
+ *
+ * Allocating takes an object off a ready list. Once that drops below the
+ * low watermark, the pool kicks a refill thread, which allocates objects from
+ * the vka, and so has the kernel retype and zero them, until the list is back
+ * up to the high watermark. Only when the list is empty does an allocation
+ * wait for the refill, or go to the vka itself if none was started.
+ *
+ * The refill thread should run at a lower priority than the thread
+ * allocating, so it only runs while that thread is blocked. The ready list is
+ * a ring with one producer and one consumer, so it can be preempted at any
+ * point. Nothing else may use the vka while a refill may be in progress: from
+ * a kick until warm_pool_idle returns.
+ */
+
+/* most objects on a ready list, a power of two */
+#define WARM_MAX_OBJECTS 64
+
+typedef struct {
+    vka_t *vka;
+    seL4_Word type;
+    seL4_Word size_bits;
+    size_t low;
+    size_t high;
+    /* notifications to start a refill, and to say it is done */
+    vka_object_t kick;
+    vka_object_t done;
+    /* a refill has been started and not waited for */
+    bool kicked;
+    /* objects ever added to and taken from the ready list, written only by
+     * the refill thread and the thread allocating respectively */
+    size_t head;
+    size_t tail;
+    vka_object_t ready[WARM_MAX_OBJECTS];
+    /* allocations that found the list empty */
+    uint64_t misses;
+} warm_pool_t;
+
+/* a pool of objects of type and size_bits, as for vka_alloc_object, filled
+ * to high now, and refilled to it when fewer than low are left */
+void warm_pool_init(warm_pool_t *pool, vka_t *vka, seL4_Word type, seL4_Word size_bits, size_t low,
+                    size_t high);
+
+/* take an object from the pool, or from the vka if the pool is empty. 0 on
+ * success. */
+int warm_pool_alloc(warm_pool_t *pool, vka_object_t *result);
+
+/* block until a refill that has been started is done. Call it where the
+ * thread allocating would wait for work anyway, and before using the vka. */
+void warm_pool_idle(warm_pool_t *pool);
+
+/* the body of the refill thread, which never returns */
+void warm_pool_refill(warm_pool_t *pool);
@@ -37,6 +37,11 @@
 #include <sel4utils/sel4_zf_logif.h>
 
 #include <sel4platsupport/bootinfo.h>
+#include <sel4bench/sel4bench.h>
+#include <bench/phase.h>
+
+#include "spawner.h"
+#include "pool.h"
 
 /* constants */
 #define EP_BADGE 0x61   // arbitrary (but unique) number for a badge
@@ -45,11 +50,26 @@
 #define APP_PRIORITY seL4_MaxPrio
 #define APP_IMAGE_NAME "app"
 
+/* identical workers configured by each way of spawning them in spawn_benchmark.
+ * Every frame of a worker, bss and heap included, takes a slot in our cspace
+ * either way, so this is bounded by the size of the root CNode. */
+#define SPAWN_WORKERS 8
+
+/* workers in pool_benchmark's pool, and the tasks run each way there. The
+ * pool maps the writable frames of its workers, so each takes twice the
+ * slots. */
+#define POOL_WORKERS 4
+#define POOL_TASKS 64
+#define POOL_BADGE_BASE 0x100
+
 /* global environment variables */
 seL4_BootInfo *info;
 simple_t simple;
 vka_t vka;
 allocman_t *allocman;
+
+/* how long each step of bringing up the environment takes */
+static bench_phases_t boot;
 vspace_t vspace;
 
 /* static memory for the allocator to bootstrap with */
@@ -66,13 +86,129 @@ UNUSED static sel4utils_alloc_data_t data;
 #define THREAD_2_STACK_SIZE 4096
 UNUSED static int thread_2_stack[THREAD_2_STACK_SIZE];
 
+/* configure SPAWN_WORKERS processes from the app image, without starting
+ * them, and return the cycles it took. Each is destroyed again afterwards. */
+static ccnt_t spawn_workers(spawner_image_t *image)
+{
+    static sel4utils_process_t workers[SPAWN_WORKERS];
+    sel4utils_process_config_t config = process_config_default_simple(&simple, APP_IMAGE_NAME, APP_PRIORITY);
+
+    ccnt_t start = sel4bench_get_cycle_count();
+    for (int i = 0; i < SPAWN_WORKERS; i++) {
+        if (image == NULL) {
+            int error = sel4utils_configure_process_custom(&workers[i], &vka, &vspace, config);
+            ZF_LOGF_IFERR(error, "Failed to configure worker %d", i);
+        } else {
+            spawner_configure_process(&workers[i], image, &vka, &vspace, config);
+        }
+    }
+    ccnt_t cycles = sel4bench_get_cycle_count() - start;
+
+    for (int i = 0; i < SPAWN_WORKERS; i++) {
+        sel4utils_destroy_process(&workers[i], &vka);
+    }
+    return cycles;
+}
+
+/* the app image, loaded by spawn_benchmark */
+static spawner_image_t image;
+
+/* compare loading the app's ELF into every worker with loading it once and
+ * sharing its read-only segments between them */
+static void spawn_benchmark(void)
+{
+    ccnt_t copied = spawn_workers(NULL);
+
+    ccnt_t start = sel4bench_get_cycle_count();
+    spawner_load_image(&image, &vka, &vspace, APP_IMAGE_NAME);
+    ccnt_t load = sel4bench_get_cycle_count() - start;
+    ccnt_t shared = spawn_workers(&image);
+
+    size_t pages = image.shared_pages + image.private_pages;
+    printf("spawn: %d workers loading every segment: %llu cycles, %zu image pages each\n",
+           SPAWN_WORKERS, (unsigned long long) copied / SPAWN_WORKERS, pages);
+    printf("spawn: %d workers sharing read-only segments: %llu cycles, %zu image pages each "
+           "(and %llu cycles, %zu pages to load the image once)\n",
+           SPAWN_WORKERS, (unsigned long long) shared / SPAWN_WORKERS, image.private_pages,
+           (unsigned long long) load, pages);
+}
+
+/* wait for the message a worker sends once it is running, and return its
+ * badge. It is never replied to. */
+static seL4_Word wait_worker(seL4_CPtr ep)
+{
+    seL4_Word badge = 0;
+    UNUSED seL4_MessageInfo_t tag = seL4_Recv(ep, &badge);
+    ZF_LOGF_IF(seL4_GetMR(0) != MSG_DATA, "Unexpected message from worker %#" PRIxPTR, badge);
+    return badge;
+}
+
+/* compare the time from deciding to run a task until its worker is running
+ * it, for a worker created for each task and for one from a pool */
+static void pool_benchmark(void)
+{
+    vka_object_t ep_object = {0};
+    int error = vka_alloc_endpoint(&vka, &ep_object);
+    ZF_LOGF_IFERR(error, "Failed to allocate the pool's endpoint");
+    cspacepath_t ep;
+    vka_cspace_make_path(&vka, ep_object.cptr, &ep);
+    sel4utils_process_config_t config = process_config_default_simple(&simple, APP_IMAGE_NAME, APP_PRIORITY);
+
+    ccnt_t fresh = 0;
+    for (int i = 0; i < POOL_TASKS; i++) {
+        sel4utils_process_t worker;
+        ccnt_t start = sel4bench_get_cycle_count();
+        spawner_configure_process(&worker, &image, &vka, &vspace, config);
+        seL4_CPtr worker_ep = sel4utils_mint_cap_to_process(&worker, ep, seL4_AllRights, EP_BADGE);
+        ZF_LOGF_IF(worker_ep == 0, "Failed to mint an endpoint to a worker");
+        seL4_Word argc = 2;
+        char string_args[argc][WORD_STRING_SIZE];
+        char *argv[argc];
+        sel4utils_create_word_args(string_args, argv, argc, worker_ep, (seL4_Word) i);
+        error = sel4utils_spawn_process_v(&worker, &vka, &vspace, argc, argv, 1);
+        ZF_LOGF_IFERR(error, "Failed to start a worker");
+        wait_worker(ep.capPtr);
+        fresh += sel4bench_get_cycle_count() - start;
+        sel4utils_destroy_process(&worker, &vka);
+    }
+
+    static pool_t pool;
+    ccnt_t start = sel4bench_get_cycle_count();
+    pool_init(&pool, &image, &vka, &vspace, config, ep, POOL_BADGE_BASE, POOL_WORKERS);
+    ccnt_t init = sel4bench_get_cycle_count() - start;
+
+    ccnt_t dispatch = 0, recycle = 0;
+    for (int i = 0; i < POOL_TASKS; i++) {
+        start = sel4bench_get_cycle_count();
+        int index = pool_dispatch(&pool);
+        ZF_LOGF_IF(index < 0, "No idle worker in the pool");
+        seL4_Word badge = wait_worker(ep.capPtr);
+        ZF_LOGF_IF(pool_worker(&pool, badge) != index, "Worker %d ran instead of %d",
+                   pool_worker(&pool, badge), index);
+        ccnt_t running = sel4bench_get_cycle_count();
+        dispatch += running - start;
+        pool_recycle(&pool, index);
+        recycle += sel4bench_get_cycle_count() - running;
+    }
+
+    printf("pool: %d tasks on fresh workers: %llu cycles each until running\n",
+           POOL_TASKS, (unsigned long long) fresh / POOL_TASKS);
+    printf("pool: %d tasks on %d pooled workers: %llu cycles each until running, %llu to recycle "
+           "(and %llu cycles to create the pool)\n", POOL_TASKS, POOL_WORKERS,
+           (unsigned long long) dispatch / POOL_TASKS, (unsigned long long) recycle / POOL_TASKS,
+           (unsigned long long) init);
+}
+
 int main(void)
 {
     UNUSED int error = 0;
+    sel4bench_init();
+    bench_phases_start(&boot);
 
     /* get boot info */
     info = platsupport_get_bootinfo();
     ZF_LOGF_IF(info == NULL, "Failed to get bootinfo.");
+    bench_phase_end(&boot, "bootinfo");
 
     /* Set up logging and give us a name: useful for debugging if the thread faults */
     zf_log_set_tag_prefix("dynamic-3:");
@@ -80,9 +216,13 @@ int main(void)
 
     /* init simple */
     simple_default_init_bootinfo(&simple, info);
+    bench_phase_end(&boot, "simple");
 
+#ifndef BOOT_QUIET
     /* print out bootinfo and other info about simple */
     simple_print(&simple);
+    bench_phase_end(&boot, "simple_print");
+#endif
 
     /* create an allocator */
     allocman = bootstrap_use_current_simple(&simple, ALLOCATOR_STATIC_POOL_SIZE,
@@ -93,12 +233,14 @@ int main(void)
 
     /* create a vka (interface for interacting with the underlying allocator) */
     allocman_make_vka(&vka, allocman);
+    bench_phase_end(&boot, "allocator");
 
     /* TASK 1: create a vspace object to manage our vspace */
     sel4utils_bootstrap_vspace_with_bootinfo_leaky(&vspace, &data, simple_get_pd(&simple), &vka, info);
     ZF_LOGF_IFERR(error, "Failed to prepare root thread's VSpace for use.\n"
                          "\tsel4utils_bootstrap_vspace_with_bootinfo reserves important vaddresses.\n"
                          "\tIts failure means we can't safely use our vaddrspace.\n");
+    bench_phase_end(&boot, "vspace");
 
     /* fill the allocator with virtual memory */
     void *vaddr;
@@ -108,6 +250,11 @@ int main(void)
     ZF_LOGF_IF(virtual_reservation.res == NULL, "Failed to reserve a chunk of memory.\n");
     bootstrap_configure_virtual_pool(allocman, vaddr,
                                      ALLOCATOR_VIRTUAL_POOL_SIZE, simple_get_pd(&simple));
+    bench_phase_end(&boot, "virtual pool");
+
+    spawn_benchmark();
+    pool_benchmark();
+    bench_phase_end(&boot, "spawn benchmarks");
 
     /* TASK 2: use sel4utils to make a new process */
     sel4utils_process_t new_process;
@@ -149,6 +296,8 @@ int main(void)
                          "\tVerify: the new thread is being executed in the root thread's VSpace.\n"
                          "\tIn this case, the CSpaces are different, but the VSpaces are the same.\n"
                          "\tDouble check your vspace_t argument.\n");
+    bench_phase_end(&boot, "spawn");
+    bench_phases_print("dynamic-3: boot", &boot);
 
     /* we are done, say hello */
     printf("main: hello world\n");
@@ -0,0 +1,124 @@
+/*
+ * Copyright 2018, Data61
+ * Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+ * ABN 41 687 119 230.
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(DATA61_BSD)
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include <sel4/sel4.h>
+#include <sel4utils/process.h>
+#include <sel4utils/util.h>
+#include <utils/util.h>
+#include <utils/zf_log.h>
+#include <sel4utils/sel4_zf_logif.h>
+
+#include "pool.h"
+
+#define REGS_WORDS (sizeof(seL4_UserContext) / sizeof(seL4_Word))
+
+static void init_worker(pool_t *pool, int index, vka_t *vka, vspace_t *vspace,
+                        sel4utils_process_config_t config, cspacepath_t ep)
+{
+    pool_worker_t *worker = &pool->workers[index];
+    sel4utils_process_t *process = &worker->process;
+    spawner_configure_process(process, pool->image, vka, vspace, config);
+
+    seL4_CPtr worker_ep = sel4utils_mint_cap_to_process(process, ep, seL4_AllRights,
+                                                        pool->badge_base + index);
+    ZF_LOGF_IF(worker_ep == 0, "Failed to mint an endpoint to worker %d", index);
+
+    /* set it up to run, without starting it */
+    seL4_Word argc = 2;
+    char string_args[argc][WORD_STRING_SIZE];
+    char *argv[argc];
+    sel4utils_create_word_args(string_args, argv, argc, worker_ep, (seL4_Word) index);
+    int error = sel4utils_spawn_process_v(process, vka, vspace, argc, argv, 0);
+    ZF_LOGF_IFERR(error, "Failed to set up worker %d", index);
+
+    error = seL4_TCB_ReadRegisters(process->thread.tcb.cptr, 0, 0, REGS_WORDS, &worker->regs);
+    ZF_LOGF_IFERR(error, "Failed to read the registers of worker %d", index);
+
+    /* keep the memory a reset writes to mapped */
+    for (size_t s = 0; s < pool->image->num_segments; s++) {
+        spawner_segment_t *segment = &pool->image->segments[s];
+        if (segment->writable) {
+            worker->segments[s] = vspace_share_mem(&process->vspace, vspace, (void *) segment->vstart,
+                                                   segment->num_pages, seL4_PageBits, seL4_AllRights, 1);
+            ZF_LOGF_IF(worker->segments[s] == NULL, "Failed to map the data of worker %d", index);
+        }
+    }
+
+    /* the arguments and environment are laid out above the stack pointer */
+    uintptr_t sp = sel4utils_get_sp(worker->regs);
+    uintptr_t stack_top = (uintptr_t) process->thread.stack_top;
+    uintptr_t stack_start = ROUND_DOWN(sp, BIT(seL4_PageBits));
+    worker->stack_size = stack_top - stack_start;
+    worker->stack = vspace_share_mem(&process->vspace, vspace, (void *) stack_start,
+                                     worker->stack_size >> seL4_PageBits, seL4_PageBits, seL4_AllRights, 1);
+    worker->stack_image = malloc(worker->stack_size);
+    ZF_LOGF_IF(worker->stack == NULL || worker->stack_image == NULL,
+               "Failed to keep the stack of worker %d", index);
+    memcpy(worker->stack_image, worker->stack, worker->stack_size);
+}
+
+void pool_init(pool_t *pool, spawner_image_t *image, vka_t *vka, vspace_t *vspace,
+               sel4utils_process_config_t config, cspacepath_t ep, seL4_Word badge_base, int num_workers)
+{
+    ZF_LOGF_IF(num_workers > POOL_MAX_WORKERS, "At most %d workers in a pool", POOL_MAX_WORKERS);
+    pool->image = image;
+    pool->badge_base = badge_base;
+    pool->num_workers = num_workers;
+    pool->num_idle = 0;
+    for (int i = 0; i < num_workers; i++) {
+        init_worker(pool, i, vka, vspace, config, ep);
+        pool->idle[pool->num_idle++] = i;
+    }
+}
+
+int pool_dispatch(pool_t *pool)
+{
+    if (pool->num_idle == 0) {
+        return -1;
+    }
+    int index = pool->idle[--pool->num_idle];
+    int error = seL4_TCB_Resume(pool->workers[index].process.thread.tcb.cptr);
+    ZF_LOGF_IFERR(error, "Failed to start worker %d", index);
+    return index;
+}
+
+int pool_worker(pool_t *pool, seL4_Word badge)
+{
+    if (badge < pool->badge_base || badge - pool->badge_base >= pool->num_workers) {
+        return -1;
+    }
+    return badge - pool->badge_base;
+}
+
+void pool_recycle(pool_t *pool, int index)
+{
+    pool_worker_t *worker = &pool->workers[index];
+    seL4_CPtr tcb = worker->process.thread.tcb.cptr;
+
+    /* also takes it out of any IPC it is blocked in */
+    int error = seL4_TCB_Suspend(tcb);
+    ZF_LOGF_IFERR(error, "Failed to stop worker %d", index);
+    error = seL4_TCB_WriteRegisters(tcb, 0, 0, REGS_WORDS, &worker->regs);
+    ZF_LOGF_IFERR(error, "Failed to reset the registers of worker %d", index);
+
+    for (size_t s = 0; s < pool->image->num_segments; s++) {
+        spawner_segment_t *segment = &pool->image->segments[s];
+        if (segment->writable) {
+            memcpy(worker->segments[s], segment->vaddr, segment->num_pages << seL4_PageBits);
+        }
+    }
+    memcpy(worker->stack, worker->stack_image, worker->stack_size);
+
+    pool->idle[pool->num_idle++] = index;
+}
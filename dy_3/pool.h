@@ -0,0 +1,82 @@
+/*
+ * Copyright 2018, Data61
+ * Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+ * ABN 41 687 119 230.
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(DATA61_BSD)
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <sel4/sel4.h>
+#include <vka/vka.h>
+#include <vspace/vspace.h>
+#include <sel4utils/process.h>
+
+#include "spawner.h"
+
+/*
+ * A pool of worker processes created up front, to run one task each and then
+ * be recycled rather than destroyed.
+ *
+ * pool_init configures every worker from a spawner image, mints it a badged
+ * copy of an endpoint and sets it up to run with that cap as argv[0] and its
+ * index as argv[1], but does not start it. Dispatching a task only resumes
+ * an idle worker.
+ *
+ * Once its task is done, pool_recycle suspends the worker and puts it back
+ * the way it was before it first ran: its registers, its writable segments
+ * and the arguments at the top of its stack. The pool keeps these mapped so
+ * a reset is a few copies. Anything else the worker changed, such as caps in
+ * its cspace, is not undone.
+ */
+
+/* most workers in a pool */
+#define POOL_MAX_WORKERS 16
+
+typedef struct {
+    sel4utils_process_t process;
+    /* registers as set up to enter the image */
+    seL4_UserContext regs;
+    /* the worker's writable segments, in the order of the image's segments,
+     * and the top of its stack as mapped into the spawner */
+    void *segments[SPAWNER_MAX_SEGMENTS];
+    void *stack;
+    /* what the top of the stack held before the worker first ran */
+    void *stack_image;
+    size_t stack_size;
+} pool_worker_t;
+
+typedef struct {
+    spawner_image_t *image;
+    seL4_Word badge_base;
+    int num_workers;
+    pool_worker_t workers[POOL_MAX_WORKERS];
+    /* indices of idle workers, used as a stack */
+    int num_idle;
+    int idle[POOL_MAX_WORKERS];
+} pool_t;
+
+/*
+ * Create num_workers workers from image, each with a copy of the endpoint at
+ * ep badged badge_base + its index. vka and vspace are the spawner's, as
+ * passed to spawner_load_image. Failing to create any of them is fatal.
+ */
+void pool_init(pool_t *pool, spawner_image_t *image, vka_t *vka, vspace_t *vspace,
+               sel4utils_process_config_t config, cspacepath_t ep, seL4_Word badge_base, int num_workers);
+
+/* start an idle worker on its task, and return its index, or -1 if every
+ * worker is busy */
+int pool_dispatch(pool_t *pool);
+
+/* the index of the worker whose messages carry badge, or -1 */
+int pool_worker(pool_t *pool, seL4_Word badge);
+
+/* stop the worker at index, reset it and make it idle again */
+void pool_recycle(pool_t *pool, int index);
@@ -0,0 +1,126 @@
+/*
+ * Copyright 2018, Data61
+ * Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+ * ABN 41 687 119 230.
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(DATA61_BSD)
+ */
+#include <autoconf.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <sel4/sel4.h>
+#include <cpio/cpio.h>
+#include <elf/elf.h>
+#include <vka/object.h>
+#include <utils/util.h>
+#include <utils/zf_log.h>
+#include <sel4utils/sel4_zf_logif.h>
+
+#include <bench/segment.h>
+
+#include "spawner.h"
+
+/* the archive the images are linked into, see MakeCPIO */
+extern char _cpio_archive[];
+extern char _cpio_archive_end[];
+
+/* allocate num frames, mapped into vspace, and return where */
+static void *new_frames(vka_t *vka, vspace_t *vspace, size_t num, seL4_CPtr *caps)
+{
+    for (size_t i = 0; i < num; i++) {
+        vka_object_t frame;
+        int error = vka_alloc_frame(vka, seL4_PageBits, &frame);
+        ZF_LOGF_IFERR(error, "Failed to allocate frame %zu of %zu", i, num);
+        caps[i] = frame.cptr;
+    }
+    void *vaddr = vspace_map_pages(vspace, caps, NULL, seL4_AllRights, num, seL4_PageBits, 1);
+    ZF_LOGF_IF(vaddr == NULL, "Failed to map %zu frames into the spawner", num);
+    return vaddr;
+}
+
+void spawner_load_image(spawner_image_t *image, vka_t *vka, vspace_t *vspace, const char *image_name)
+{
+    unsigned long size;
+    unsigned long cpio_len = _cpio_archive_end - _cpio_archive;
+    const void *file = cpio_get_file(_cpio_archive, cpio_len, image_name, &size);
+    ZF_LOGF_IF(file == NULL, "No image %s in the archive", image_name);
+
+    elf_t elf;
+    int error = elf_newFile(file, size, &elf);
+    ZF_LOGF_IF(error, "Image %s is not a valid ELF file", image_name);
+
+    *image = (spawner_image_t) {
+        .image_name = image_name,
+    };
+    size_t num_headers = elf_getNumProgramHeaders(&elf);
+    for (size_t i = 0; i < num_headers; i++) {
+        if (elf_getProgramHeaderType(&elf, i) != PT_LOAD) {
+            continue;
+        }
+        ZF_LOGF_IF(image->num_segments == SPAWNER_MAX_SEGMENTS, "Image %s has too many segments", image_name);
+        spawner_segment_t *segment = &image->segments[image->num_segments++];
+
+        uintptr_t vaddr = elf_getProgramHeaderVaddr(&elf, i);
+        size_t file_size = elf_getProgramHeaderFileSize(&elf, i);
+        size_t mem_size = elf_getProgramHeaderMemorySize(&elf, i);
+        segment->vstart = ROUND_DOWN(vaddr, BIT(seL4_PageBits));
+        segment->num_pages = (ROUND_UP(vaddr + mem_size, BIT(seL4_PageBits)) - segment->vstart) >> seL4_PageBits;
+        segment->writable = elf_getProgramHeaderFlags(&elf, i) & PF_W;
+
+        segment->caps = malloc(segment->num_pages * sizeof(seL4_CPtr));
+        ZF_LOGF_IF(segment->caps == NULL, "Failed to allocate frame caps for %s", image_name);
+        segment->vaddr = new_frames(vka, vspace, segment->num_pages, segment->caps);
+
+        memset(segment->vaddr, 0, segment->num_pages << seL4_PageBits);
+        memcpy(segment->vaddr + (vaddr - segment->vstart), elf_getProgramSegment(&elf, i), file_size);
+#ifdef CONFIG_ARCH_ARM
+        /* the segment was written through the data cache, but will be fetched
+         * through the instruction cache */
+        for (size_t p = 0; p < segment->num_pages; p++) {
+            error = seL4_ARM_Page_Unify_Instruction(segment->caps[p], 0, BIT(seL4_PageBits));
+            ZF_LOGF_IFERR(error, "Failed to clean loaded frame");
+        }
+#endif
+
+        if (segment->writable) {
+            image->private_pages += segment->num_pages;
+        } else {
+            image->shared_pages += segment->num_pages;
+        }
+    }
+}
+
+static spawner_segment_t *find_segment(spawner_image_t *image, void *vstart)
+{
+    for (size_t i = 0; i < image->num_segments; i++) {
+        if (image->segments[i].vstart == ROUND_DOWN((uintptr_t) vstart, BIT(seL4_PageBits))) {
+            return &image->segments[i];
+        }
+    }
+    return NULL;
+}
+
+void spawner_configure_process(sel4utils_process_t *process, spawner_image_t *image, vka_t *vka,
+                               vspace_t *vspace, sel4utils_process_config_t config)
+{
+    bench_segment_configure_process(process, vka, vspace, config);
+
+    for (int i = 0; i < process->num_elf_regions; i++) {
+        sel4utils_elf_region_t *region = &process->elf_regions[i];
+        spawner_segment_t *segment = find_segment(image, region->elf_vstart);
+        ZF_LOGF_IF(segment == NULL, "No segment of %s loaded at %p", image->image_name, region->elf_vstart);
+
+        /* read-only segments map the image's frames, writable ones get a
+         * copy of their own, freed with the process */
+        size_t num = segment->num_pages;
+        bench_segment_map(process, region, vka, vspace, segment->vstart, num, segment->caps,
+                          segment->writable ? 0 : num, segment->vstart, segment->vaddr,
+                          num << seL4_PageBits);
+    }
+}
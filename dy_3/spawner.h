@@ -0,0 +1,70 @@
+/*
+ * Copyright 2018, Data61
+ * Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+ * ABN 41 687 119 230.
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(DATA61_BSD)
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <sel4/sel4.h>
+#include <vka/vka.h>
+#include <vspace/vspace.h>
+#include <sel4utils/process.h>
+
+/*
+ * Spawn many processes from one ELF image without loading it each time.
+ *
+ * spawner_load_image reads the image out of the CPIO archive once, into
+ * frames kept mapped in the spawner. Each process configured from it gets
+ * copies of the caps to the read-only and executable segments' frames, so
+ * every process maps the same frames. Writable segments (data and bss) get
+ * fresh frames per process, copied from the loaded image.
+ *
+ * Processes are destroyed with sel4utils_destroy_process as usual. That
+ * deletes their copies of the shared caps, but leaves the frames themselves
+ * to the image, which is never freed. Failing to allocate anything is fatal.
+ */
+
+/* most PT_LOAD segments an image can have */
+#define SPAWNER_MAX_SEGMENTS 8
+
+typedef struct {
+    /* page aligned range the segment covers in each process */
+    uintptr_t vstart;
+    size_t num_pages;
+    bool writable;
+    /* the loaded frames, and where they are mapped in the spawner */
+    seL4_CPtr *caps;
+    void *vaddr;
+} spawner_segment_t;
+
+typedef struct {
+    const char *image_name;
+    size_t num_segments;
+    spawner_segment_t segments[SPAWNER_MAX_SEGMENTS];
+    /* pages every process shares, and pages each one gets its own copy of */
+    size_t shared_pages;
+    size_t private_pages;
+} spawner_image_t;
+
+/* load image_name from the CPIO archive into frames from vka, mapped into
+ * vspace */
+void spawner_load_image(spawner_image_t *image, vka_t *vka, vspace_t *vspace, const char *image_name);
+
+/*
+ * Like sel4utils_configure_process_custom, but map the process's segments
+ * from image instead of loading them. config.image_name must name the same
+ * image; config.do_elf_load is ignored. vka and vspace are the spawner's, as
+ * passed to spawner_load_image.
+ */
+void spawner_configure_process(sel4utils_process_t *process, spawner_image_t *image, vka_t *vka,
+                               vspace_t *vspace, sel4utils_process_config_t config);
@@ -13,19 +13,32 @@
 #include <stdio.h>
 #include <assert.h>
 
+#include <stdlib.h>
+
 #include <sel4/sel4.h>
 #include <sel4utils/process.h>
+#include <sel4bench/sel4bench.h>
+
+#include "timepage.h"
 
 /* constants */
 #define EP_CPTR SEL4UTILS_FIRST_FREE // where the cap for the endpoint was placed.
 #define MSG_DATA 0x2 //  arbitrary data to send
 
+/* reads of the time page to time */
+#define TIME_READS 1000
+
 int main(int argc, char **argv) {
     seL4_MessageInfo_t tag;
-    seL4_Word msg;
+    uint64_t time = 0;
 
     printf("timer client: hey hey hey\n");
 
+    /* the root task passes the address of the time page */
+    assert(argc >= 1);
+    const time_page_t *time_page = (const time_page_t *) atol(argv[0]);
+    sel4bench_init();
+
     /* set the data to send. We send it in the first message register */
     tag = seL4_MessageInfo_new(0, 0, 0, 1);
     seL4_SetMR(0, MSG_DATA);
@@ -34,10 +47,30 @@ int main(int argc, char **argv) {
     tag = seL4_Call(EP_CPTR, tag);
 
     /* check that we got the expected repy */
-    assert(seL4_MessageInfo_get_length(tag) == 1);
-    msg = seL4_GetMR(0);
+    assert(seL4_MessageInfo_get_length(tag) == TIME_WORDS);
+    for (int i = 0; i < TIME_WORDS; i++) {
+        time |= (uint64_t) seL4_GetMR(i) << (i * seL4_WordBits);
+    }
+
+    /* the root task keeps ticking until we call again, so the time page is
+     * still being published to. Read it straight away to compare it with the
+     * time we were sent, then time the reads. */
+    uint64_t now = time_page_read(time_page);
+    printf("timer client wakes up:\n got the current timer tick:\n %llu\n", (unsigned long long) time);
+    printf(" read the time page:\n %llu, %lld ns after the IPC value\n", (unsigned long long) now,
+           (long long) (now - time));
+
+    /* what a read costs, without entering the kernel */
+    ccnt_t start = sel4bench_get_cycle_count();
+    for (int i = 0; i < TIME_READS; i++) {
+        now = time_page_read(time_page);
+    }
+    ccnt_t cycles = sel4bench_get_cycle_count() - start;
+    printf(" %llu cycles per read\n", (unsigned long long) cycles / TIME_READS);
 
-    printf("timer client wakes up:\n got the current timer tick:\n %zu\n", msg);
+    /* tell the root task we are done, so it stops the timer */
+    tag = seL4_MessageInfo_new(0, 0, 0, 0);
+    seL4_Call(EP_CPTR, tag);
 
     return 0;
 }
@@ -0,0 +1,114 @@
+/*
+ * Copyright 2018, Data61
+ * Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+ * ABN 41 687 119 230.
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(DATA61_BSD)
+ */
+#include <autoconf.h>
+
+#include <stdlib.h>
+
+#include <sel4/sel4.h>
+#include <cpio/cpio.h>
+#include <elf/elf.h>
+#include <utils/util.h>
+#include <utils/zf_log.h>
+#include <sel4utils/sel4_zf_logif.h>
+
+#include <bench/segment.h>
+
+#include "loader.h"
+
+/* see archive.S */
+extern char _cpio_archive[];
+extern char _cpio_archive_end[];
+
+/* the start of our own image, which the first of bootinfo's user image frames
+ * is mapped at */
+extern char __executable_start[];
+
+/* cap to the frame of our image mapped at vaddr */
+static seL4_CPtr image_frame(seL4_BootInfo *info, uintptr_t vaddr)
+{
+    uintptr_t base = ROUND_DOWN((uintptr_t) __executable_start, BIT(seL4_PageBits));
+    seL4_Word index = (vaddr - base) >> seL4_PageBits;
+    ZF_LOGF_IF(vaddr < base || index >= info->userImageFrames.end - info->userImageFrames.start,
+               "%p is not in our image", (void *) vaddr);
+    return info->userImageFrames.start + index;
+}
+
+static void load_segment(sel4utils_process_t *process, vka_t *vka, vspace_t *vspace,
+                         seL4_BootInfo *info, elf_t *elf, const char *file, size_t header,
+                         sel4utils_elf_region_t *region, loader_stats_t *stats)
+{
+    uintptr_t vaddr = elf_getProgramHeaderVaddr(elf, header);
+    size_t file_size = elf_getProgramHeaderFileSize(elf, header);
+    size_t mem_size = elf_getProgramHeaderMemorySize(elf, header);
+    const char *contents = file + elf_getProgramHeaderOffset(elf, header);
+    seL4_Word flags = elf_getProgramHeaderFlags(elf, header);
+
+    uintptr_t vstart = ROUND_DOWN(vaddr, BIT(seL4_PageBits));
+    size_t num = (ROUND_UP(vaddr + mem_size, BIT(seL4_PageBits)) - vstart) >> seL4_PageBits;
+
+    /* where the page at vstart is in the archive. The pages before the one
+     * the bss starts in hold nothing but the file. */
+    uintptr_t archived = (uintptr_t) contents - (vaddr - vstart);
+    size_t mapped = 0;
+    if (!(flags & PF_W) && IS_ALIGNED(archived, seL4_PageBits)) {
+        mapped = file_size == mem_size ? num : (vaddr + file_size - vstart) >> seL4_PageBits;
+    }
+
+    seL4_CPtr *archive_frames = NULL;
+    if (mapped > 0) {
+        archive_frames = malloc(mapped * sizeof(seL4_CPtr));
+        ZF_LOGF_IF(archive_frames == NULL, "Failed to allocate archive frame caps");
+        for (size_t p = 0; p < mapped; p++) {
+            archive_frames[p] = image_frame(info, archived + (p << seL4_PageBits));
+        }
+    }
+    bench_segment_map(process, region, vka, vspace, vstart, num, archive_frames, mapped,
+                      vaddr, contents, file_size);
+    free(archive_frames);
+
+    if (stats != NULL) {
+        stats->mapped_pages += mapped;
+        stats->copied_pages += num - mapped;
+    }
+}
+
+void loader_configure_process(sel4utils_process_t *process, vka_t *vka, vspace_t *vspace,
+                              seL4_BootInfo *info, sel4utils_process_config_t config,
+                              loader_stats_t *stats)
+{
+    unsigned long size;
+    unsigned long cpio_len = _cpio_archive_end - _cpio_archive;
+    const char *file = cpio_get_file(_cpio_archive, cpio_len, config.image_name, &size);
+    ZF_LOGF_IF(file == NULL, "No image %s in the archive", config.image_name);
+
+    elf_t elf;
+    int error = elf_newFile(file, size, &elf);
+    ZF_LOGF_IF(error, "Image %s is not a valid ELF file", config.image_name);
+
+    bench_segment_configure_process(process, vka, vspace, config);
+
+    size_t num_headers = elf_getNumProgramHeaders(&elf);
+    for (size_t i = 0; i < num_headers; i++) {
+        if (elf_getProgramHeaderType(&elf, i) != PT_LOAD) {
+            continue;
+        }
+        uintptr_t vstart = ROUND_DOWN(elf_getProgramHeaderVaddr(&elf, i), BIT(seL4_PageBits));
+        sel4utils_elf_region_t *region = NULL;
+        for (int r = 0; r < process->num_elf_regions; r++) {
+            if (ROUND_DOWN((uintptr_t) process->elf_regions[r].elf_vstart, BIT(seL4_PageBits)) == vstart) {
+                region = &process->elf_regions[r];
+            }
+        }
+        ZF_LOGF_IF(region == NULL, "No region reserved for the segment at %p", (void *) vstart);
+        load_segment(process, vka, vspace, info, &elf, file, i, region, stats);
+    }
+}
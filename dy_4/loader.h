@@ -0,0 +1,51 @@
+/*
+ * Copyright 2018, Data61
+ * Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+ * ABN 41 687 119 230.
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(DATA61_BSD)
+ */
+#pragma once
+
+#include <stddef.h>
+
+#include <sel4/sel4.h>
+#include <vka/vka.h>
+#include <vspace/vspace.h>
+#include <sel4utils/process.h>
+
+/*
+ * Load processes from the CPIO archive linked into our image without copying
+ * their read-only segments.
+ *
+ * make_cpio.py starts every file in the archive on a page boundary, and
+ * archive.S aligns the archive itself. The pages of a read-only segment are
+ * then whole frames of our own image, which the kernel gave us caps to in
+ * bootinfo. Each process maps copies of those caps. Writable segments, and
+ * any page of a segment that is partly bss, are copied into fresh frames as
+ * sel4utils would. So is everything if the archive turns out not to be
+ * aligned.
+ *
+ * The processes can see the bytes of the archive either side of a segment in
+ * the pages it shares, read-only.
+ */
+
+typedef struct {
+    /* pages mapped from the archive, and pages copied into fresh frames */
+    size_t mapped_pages;
+    size_t copied_pages;
+} loader_stats_t;
+
+/*
+ * Like sel4utils_configure_process_custom, but with the segments of
+ * config.image_name loaded as above. vka and vspace are ours, as set up
+ * from info. Adds the pages loaded to stats if it is not NULL. Failing to
+ * allocate anything is fatal.
+ */
+void loader_configure_process(sel4utils_process_t *process, vka_t *vka, vspace_t *vspace,
+                              seL4_BootInfo *info, sel4utils_process_config_t config,
+                              loader_stats_t *stats);
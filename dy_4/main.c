@@ -40,6 +40,13 @@
 #include <platsupport/plat/timer.h>
 #include <platsupport/ltimer.h>
 
+#include <sel4bench/sel4bench.h>
+#include <bench/latency.h>
+#include <bench/phase.h>
+
+#include "timepage.h"
+#include "loader.h"
+
 /* constants */
 #define EP_BADGE 0x61   // arbitrary (but unique) number for a badge
 #define MSG_DATA 0x6161 // arbitrary data to send
@@ -47,11 +54,28 @@
 #define APP_PRIORITY seL4_MaxPrio
 #define APP_IMAGE_NAME "client"
 
+#ifdef TIMER_POLL
+/* rather than block for each tick, spin on seL4_Poll of the notification
+ * and only block once nothing has come for TIMER_POLL_IDLE_NS */
+#define TIMER_POLL_IDLE_NS (10 * NS_IN_MS)
+#define TICK_PATH "polled"
+#else
+#define TICK_PATH "blocked"
+#endif
+
+/* processes configured each way at boot by spawn_benchmark. Every frame of
+ * each, bss and heap included, takes a slot in our cspace, so this is
+ * bounded by its size. */
+#define SPAWN_PROCESSES 8
+
 /* global environment variables */
 seL4_BootInfo *info;
 simple_t simple;
 vka_t vka;
 allocman_t *allocman;
+
+/* how long each step of bringing up the environment takes */
+static bench_phases_t boot;
 vspace_t vspace;
 ltimer_t timer;
 
@@ -72,21 +96,72 @@ UNUSED static int thread_2_stack[THREAD_2_STACK_SIZE];
 /* convenience function */
 extern void name_thread(seL4_CPtr tcb, char *name);
 
+/* configure SPAWN_PROCESSES clients without starting them, and destroy them
+ * again. Returns the cycles the configuring took. */
+static ccnt_t spawn_processes(bool from_archive, loader_stats_t *stats)
+{
+    static sel4utils_process_t processes[SPAWN_PROCESSES];
+    sel4utils_process_config_t config = process_config_default_simple(&simple, APP_IMAGE_NAME, APP_PRIORITY);
+
+    ccnt_t start = sel4bench_get_cycle_count();
+    for (int i = 0; i < SPAWN_PROCESSES; i++)
+    {
+        if (from_archive)
+        {
+            loader_configure_process(&processes[i], &vka, &vspace, info, config, stats);
+        }
+        else
+        {
+            int error = sel4utils_configure_process_custom(&processes[i], &vka, &vspace, config);
+            assert(error == 0);
+        }
+    }
+    ccnt_t cycles = sel4bench_get_cycle_count() - start;
+
+    for (int i = 0; i < SPAWN_PROCESSES; i++)
+    {
+        sel4utils_destroy_process(&processes[i], &vka);
+    }
+    return cycles;
+}
+
+/* compare the cost of copying every segment of the client at boot with
+ * mapping its read-only segments from the archive */
+static void spawn_benchmark(void)
+{
+    ccnt_t copied = spawn_processes(false, NULL);
+    loader_stats_t stats = {0};
+    ccnt_t mapped = spawn_processes(true, &stats);
+
+    printf("main: spawned %d processes copying every segment in %llu cycles\n", SPAWN_PROCESSES,
+           (unsigned long long) copied);
+    printf("main: spawned %d processes mapping from the archive in %llu cycles, "
+           "%zu pages mapped and %zu copied each\n", SPAWN_PROCESSES, (unsigned long long) mapped,
+           stats.mapped_pages / SPAWN_PROCESSES, stats.copied_pages / SPAWN_PROCESSES);
+}
+
 int main(void)
 {
     UNUSED int error;
+    sel4bench_init();
+    bench_phases_start(&boot);
     /* get boot info */
     info = platsupport_get_bootinfo();
     ZF_LOGF_IF(info == NULL, "Failed to get bootinfo.");
+    bench_phase_end(&boot, "bootinfo");
 
     /* give us a name: useful for debugging if the thread faults */
     name_thread(seL4_CapInitThreadTCB, "dynamic-4");
 
     /* init simple */
     simple_default_init_bootinfo(&simple, info);
+    bench_phase_end(&boot, "simple");
 
+#ifndef BOOT_QUIET
     /* print out bootinfo and other info about simple */
     simple_print(&simple);
+    bench_phase_end(&boot, "simple_print");
+#endif
 
     /* create an allocator */
     allocman = bootstrap_use_current_simple(&simple, ALLOCATOR_STATIC_POOL_SIZE,
@@ -95,10 +170,12 @@ int main(void)
 
     /* create a vka (interface for interacting with the underlying allocator) */
     allocman_make_vka(&vka, allocman);
+    bench_phase_end(&boot, "allocator");
 
     /* create a vspace object to manage our vspace */
     error = sel4utils_bootstrap_vspace_with_bootinfo_leaky(&vspace,
                                                            &data, simple_get_pd(&simple), &vka, info);
+    bench_phase_end(&boot, "vspace");
 
     /* fill the allocator with virtual memory */
     void *vaddr;
@@ -108,14 +185,17 @@ int main(void)
     assert(virtual_reservation.res);
     bootstrap_configure_virtual_pool(allocman, vaddr,
                                      ALLOCATOR_VIRTUAL_POOL_SIZE, simple_get_pd(&simple));
+    bench_phase_end(&boot, "virtual pool");
 
-    /* use sel4utils to make a new process */
+    spawn_benchmark();
+    bench_phase_end(&boot, "spawn benchmark");
+
+    /* make a new process, its read-only segments mapped from the archive */
     sel4utils_process_t new_process;
     sel4utils_process_config_t config = process_config_default_simple(&simple, APP_IMAGE_NAME, APP_PRIORITY);
     config = process_config_auth(config, simple_get_tcb(&simple));
     config = process_config_priority(config, seL4_MaxPrio);
-    error = sel4utils_configure_process_custom(&new_process, &vka, &vspace, config);
-    assert(error == 0);
+    loader_configure_process(&new_process, &vka, &vspace, info, config, NULL);
 
     /* give the new process's thread a name */
     name_thread(new_process.thread.tcb.cptr, "dynamic-4: timer_client");
@@ -140,9 +220,21 @@ int main(void)
                                                seL4_AllRights, EP_BADGE);
     assert(new_ep_cap != 0);
 
-    /* spawn the process */
-    error = sel4utils_spawn_process_v(&new_process, &vka, &vspace, 0, NULL, 1);
+    /* create the time page, and share it read-only with the new process */
+    time_page_t *time_page = vspace_new_pages(&vspace, seL4_AllRights, 1, seL4_PageBits);
+    assert(time_page != NULL);
+    void *client_time_page = vspace_share_mem(&vspace, &new_process.vspace, time_page, 1, seL4_PageBits,
+                                              seL4_CanRead, 1);
+    assert(client_time_page != NULL);
+
+    /* spawn the process, telling it where the time page is */
+    seL4_Word argc = 1;
+    char string_args[argc][WORD_STRING_SIZE];
+    char *argv[argc];
+    sel4utils_create_word_args(string_args, argv, argc, (seL4_Word) client_time_page);
+    error = sel4utils_spawn_process_v(&new_process, &vka, &vspace, argc, (char **)&argv, 1);
     assert(error == 0);
+    bench_phase_end(&boot, "spawn");
 
     /* TASK 1: create a notification object for the timer interrupt */
     /* hint: vka_alloc_notification()
@@ -174,6 +266,8 @@ int main(void)
     error = sel4platsupport_new_arch_ops(&ops, &simple, &vka);
     assert(error == 0);
     error = ltimer_default_init(&timer, ops, NULL, NULL);
+    bench_phase_end(&boot, "ltimer");
+    bench_phases_print("dynamic-4: boot", &boot);
 
     /* we are done, say hello */
     printf("main: hello world\n");
@@ -204,6 +298,17 @@ int main(void)
      */
     ltimer_set_timeout(&timer, NS_IN_MS, TIMEOUT_PERIODIC);
 
+    /* tick n is expected n ms after the timer was set. Record how late each
+     * one is seen, and how long it then takes to handle and ack. */
+    uint64_t start = 0;
+    ltimer_get_time(&timer, &start);
+    uint64_t window_ns = start;
+    ccnt_t window_cycles = sel4bench_get_cycle_count();
+    uint64_t ns_per_cycle = 0;
+    bench_latency_t tick_latency, handling;
+    bench_latency_init(&tick_latency);
+    bench_latency_init(&handling);
+
     int count = 0;
     while (1)
     {
@@ -219,18 +324,75 @@ int main(void)
          *
          */
         seL4_Word badge;
+#ifdef TIMER_POLL
+        /* the cycle count goes on from the last tick, at the measured rate */
+        ccnt_t poll_start = sel4bench_get_cycle_count();
+        do
+        {
+            seL4_Poll(ntfn_object.cptr, &badge);
+        } while (badge == 0 && (ns_per_cycle == 0 ||
+                                time_page_scale(sel4bench_get_cycle_count() - poll_start, ns_per_cycle) <
+                                TIMER_POLL_IDLE_NS));
+        if (badge == 0)
+        {
+            seL4_Wait(ntfn_object.cptr, &badge);
+        }
+#else
         seL4_Wait(ntfn_object.cptr, &badge);
+#endif
+        uint64_t woken = 0;
+        ltimer_get_time(&timer, &woken);
         sel4platsupport_irq_handle(&ops.irq_ops, MINI_IRQ_INTERFACE_NTFN_ID, badge);
+        uint64_t handled = 0;
+        ltimer_get_time(&timer, &handled);
         count++;
+        if (count <= 1000 * msg)
+        {
+            bench_latency_record(&tick_latency, start + count * NS_IN_MS, woken);
+            bench_latency_record(&handling, woken, handled);
+        }
+
+        /* publish the time with the rate of the cycle counter, measured
+           from the first tick and then over each second, so that a 32-bit
+           counter does not wrap within the window */
+        ccnt_t cycles = sel4bench_get_cycle_count();
+        if (ns_per_cycle == 0 || handled - window_ns >= NS_IN_S)
+        {
+            ns_per_cycle = ((handled - window_ns) << TIME_PAGE_SHIFT) / (ccnt_t)(cycles - window_cycles);
+            window_ns = handled;
+            window_cycles = cycles;
+        }
+        time_page_publish(time_page, handled, cycles, ns_per_cycle);
         if (count == 1000 * msg)
         {
-            break;
+            /* get the current time */
+            uint64_t time = 0;
+            ltimer_get_time(&timer, &time);
+
+            /* modify the message: the whole 64-bit time, in as many words as it takes */
+            for (int i = 0; i < TIME_WORDS; i++)
+            {
+                seL4_SetMR(i, (seL4_Word)(time >> (i * seL4_WordBits)));
+            }
+
+            /* send the modified message back, but keep ticking so that the
+               client reads the time page while it is still published to */
+            tag = seL4_MessageInfo_new(0, 0, 0, TIME_WORDS);
+            seL4_Reply(tag);
+        }
+        else if (count > 1000 * msg)
+        {
+            /* stop once the client calls again to say it is done reading */
+            seL4_NBRecv(ep_cap_path.capPtr, &sender_badge);
+            if (sender_badge == EP_BADGE)
+            {
+                break;
+            }
         }
     }
 
-    /* get the current time */
-    uint64_t time = 0;
-    ltimer_get_time(&timer, &time);
+    bench_latency_print("main: tick latency (" TICK_PATH ")", "ns", &tick_latency, true);
+    bench_latency_print("main: tick to ack", "ns", &handling, false);
 
     /*
      * TASK 5: Stop the timer
@@ -238,11 +400,8 @@ int main(void)
      */
     ltimer_destroy(&timer);
 
-    /* modify the message */
-    msg = (uint32_t)time;
-    seL4_SetMR(0, msg);
-
-    /* send the modified message back */
+    /* let the client finish */
+    tag = seL4_MessageInfo_new(0, 0, 0, 0);
     seL4_ReplyRecv(ep_cap_path.capPtr, tag, &sender_badge);
 
     return 0;
@@ -0,0 +1,73 @@
+#!/usr/bin/env python3
+#
+# Copyright 2018, Data61
+# Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+# ABN 41 687 119 230.
+#
+# This software may be distributed and modified according to the terms of
+# the BSD 2-Clause license. Note that NO WARRANTY is provided.
+# See "LICENSE_BSD2.txt" for details.
+#
+# @TAG(DATA61_BSD)
+#
+
+"""
+Write a newc CPIO archive in which the contents of every file start on a page
+boundary.
+
+Each file is preceded by a padding entry, named PAD_NAME, sized so that the
+file's own header and name end on a page boundary. Readers that look files up
+by name see the padding as just another file. With the archive itself page
+aligned in memory (see archive.S), every page of a file's contents is then a
+whole frame that can be mapped into another process instead of copied.
+"""
+
+import argparse
+import os
+
+PAGE_SIZE = 4096
+PAD_NAME = '.pad'
+HEADER_SIZE = 110
+FILE_MODE = 0o100644
+
+
+def align(n, a=4):
+    return (n + a - 1) // a * a
+
+
+def entry(name, data, mode=FILE_MODE, ino=0):
+    """one newc entry: header, name and contents, each padded to 4 bytes"""
+    name = name.encode() + b'\0'
+    fields = [ino, mode, 0, 0, 1, 0, len(data), 0, 0, 0, 0, len(name), 0]
+    header = b'070701' + b''.join(b'%08x' % f for f in fields)
+    head = header + name
+    head += b'\0' * (align(len(head)) - len(head))
+    return head + data + b'\0' * (align(len(data)) - len(data))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().split('\n')[0])
+    parser.add_argument('--output', required=True)
+    parser.add_argument('files', nargs='+')
+    args = parser.parse_args()
+
+    archive = b''
+    for ino, path in enumerate(args.files, 1):
+        name = os.path.basename(path)
+        with open(path, 'rb') as f:
+            data = f.read()
+        head = align(HEADER_SIZE + len(name) + 1)
+        if (len(archive) + head) % PAGE_SIZE:
+            pad_head = align(HEADER_SIZE + len(PAD_NAME) + 1)
+            pad = -(len(archive) + pad_head + head) % PAGE_SIZE
+            archive += entry(PAD_NAME, b'\0' * pad)
+        assert (len(archive) + head) % PAGE_SIZE == 0
+        archive += entry(name, data, ino=ino)
+    archive += entry('TRAILER!!!', b'', mode=0)
+
+    with open(args.output, 'wb') as f:
+        f.write(archive)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,86 @@
+/*
+ * Copyright 2018, Data61
+ * Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+ * ABN 41 687 119 230.
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(DATA61_BSD)
+ */
+#pragma once
+
+#include <stdint.h>
+#include <sel4/sel4.h>
+#include <utils/util.h>
+#include <sel4bench/sel4bench.h>
+
+/*
+ * A page the timer owner publishes the time in, mapped read-only into its
+ * clients so they can read the time without a system call.
+ *
+ * Each publish stores the timer's time along with the cycle count it was
+ * read at. Readers add the cycles since then, scaled by a rate the owner
+ * measures between publishes, so the time they read keeps moving in between.
+ *
+ * The fields are guarded by a sequence count. The owner makes it odd while
+ * it writes. A reader retries if it saw an odd count, or if the count
+ * changed while it read.
+ *
+ * Both sides need the cycle counter readable from user level, so they call
+ * sel4bench_init first. A 32-bit counter limits how long the time can run on
+ * after the last publish to one wrap of it.
+ */
+
+/* fixed point shift of time_page_t.ns_per_cycle */
+#define TIME_PAGE_SHIFT 24
+
+typedef struct {
+    seL4_Word seq;
+    /* the time in ns when the cycle counter read cycles */
+    uint64_t time_ns;
+    uint64_t cycles;
+    /* ns per cycle << TIME_PAGE_SHIFT, 0 until the owner has measured it */
+    uint64_t ns_per_cycle;
+} time_page_t;
+
+/* words it takes to send a 64-bit time in message registers */
+#define TIME_WORDS DIV_ROUND_UP(64, seL4_WordBits)
+
+static inline void time_page_publish(time_page_t *page, uint64_t time_ns, uint64_t cycles,
+                                     uint64_t ns_per_cycle)
+{
+    __atomic_store_n(&page->seq, page->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    page->time_ns = time_ns;
+    page->cycles = cycles;
+    page->ns_per_cycle = ns_per_cycle;
+    __atomic_store_n(&page->seq, page->seq + 1, __ATOMIC_RELEASE);
+}
+
+/* scale cycles by a rate from the page, in two halves so that it does not
+ * overflow however long ago the last publish was */
+static inline uint64_t time_page_scale(uint64_t cycles, uint64_t ns_per_cycle)
+{
+    return (cycles >> TIME_PAGE_SHIFT) * ns_per_cycle +
+           (((cycles & MASK(TIME_PAGE_SHIFT)) * ns_per_cycle) >> TIME_PAGE_SHIFT);
+}
+
+/* the current time in ns, 0 if nothing has been published yet */
+static inline uint64_t time_page_read(const time_page_t *page)
+{
+    seL4_Word seq;
+    uint64_t time_ns, cycles, ns_per_cycle;
+    do {
+        seq = __atomic_load_n(&page->seq, __ATOMIC_ACQUIRE);
+        time_ns = page->time_ns;
+        cycles = page->cycles;
+        ns_per_cycle = page->ns_per_cycle;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((seq & 1) || seq != __atomic_load_n(&page->seq, __ATOMIC_RELAXED));
+
+    /* in ccnt_t, so a counter narrower than 64 bits wraps correctly */
+    ccnt_t elapsed = sel4bench_get_cycle_count() - (ccnt_t) cycles;
+    return time_ns + time_page_scale(elapsed, ns_per_cycle);
+}
@@ -0,0 +1,62 @@
+#include <assert.h>
+#include <utils/util.h>
+
+#include "heap.h"
+
+void timeout_heap_init(timeout_heap_t *heap, timeout_t *entries, size_t capacity)
+{
+    heap->entries = entries;
+    heap->size = 0;
+    heap->capacity = capacity;
+}
+
+bool timeout_heap_push(timeout_heap_t *heap, uint64_t deadline, seL4_Word id)
+{
+    if (heap->size == heap->capacity) {
+        return false;
+    }
+
+    /* move parents down until the new timeout fits */
+    size_t i = heap->size++;
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (heap->entries[parent].deadline <= deadline) {
+            break;
+        }
+        heap->entries[i] = heap->entries[parent];
+        i = parent;
+    }
+    heap->entries[i] = (timeout_t) {
+        .deadline = deadline,
+        .id = id,
+    };
+    return true;
+}
+
+timeout_t timeout_heap_pop(timeout_heap_t *heap)
+{
+    assert(heap->size > 0);
+    timeout_t min = heap->entries[0];
+    timeout_t last = heap->entries[--heap->size];
+
+    /* move the earlier child up until the last timeout fits */
+    size_t i = 0;
+    while (1) {
+        size_t child = 2 * i + 1;
+        if (child >= heap->size) {
+            break;
+        }
+        if (child + 1 < heap->size && heap->entries[child + 1].deadline < heap->entries[child].deadline) {
+            child++;
+        }
+        if (last.deadline <= heap->entries[child].deadline) {
+            break;
+        }
+        heap->entries[i] = heap->entries[child];
+        i = child;
+    }
+    if (heap->size > 0) {
+        heap->entries[i] = last;
+    }
+    return min;
+}
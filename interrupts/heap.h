@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sel4/sel4.h>
+
+/*
+ * Binary min-heap of timeouts ordered by deadline, over an array the caller
+ * provides. The earliest timeout is always at the root, so finding it is
+ * O(1) and adding or removing a timeout is O(log n).
+ */
+
+typedef struct {
+    uint64_t deadline;
+    /* identifies the timeout to its owner */
+    seL4_Word id;
+} timeout_t;
+
+typedef struct {
+    timeout_t *entries;
+    size_t size;
+    size_t capacity;
+} timeout_heap_t;
+
+void timeout_heap_init(timeout_heap_t *heap, timeout_t *entries, size_t capacity);
+
+/* add a timeout. Returns false if the heap is full. */
+bool timeout_heap_push(timeout_heap_t *heap, uint64_t deadline, seL4_Word id);
+
+/* remove and return the earliest timeout, which must exist */
+timeout_t timeout_heap_pop(timeout_heap_t *heap);
+
+static inline bool timeout_heap_empty(timeout_heap_t *heap)
+{
+    return heap->size == 0;
+}
+
+/* the earliest deadline, or UINT64_MAX if there is none */
+static inline uint64_t timeout_heap_next(timeout_heap_t *heap)
+{
+    return heap->size == 0 ? UINT64_MAX : heap->entries[0].deadline;
+}
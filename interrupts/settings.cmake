@@ -0,0 +1 @@
+    set(KernelArmExportPMUUser ON CACHE BOOL "" FORCE)
@@ -3,8 +3,15 @@
 #include <stdio.h>
 #include <assert.h>
 #include <sel4/sel4.h>
+#include <utils/util.h>
+#include <utils/time.h>
+#include <sel4bench/sel4bench.h>
 #include <timer_driver/driver.h>
 
+#include <bench/latency.h>
+
+#include "heap.h"
+
 // CSlots pre-initialised in this CSpace
 extern seL4_CPtr endpoint;
 // capability to a reply object
@@ -25,6 +32,10 @@ extern const char timer_vaddr[4096];
 extern seL4_CPtr irq_control;
 // empty slot for the irq
 extern seL4_CPtr irq_handler;
+// tcb of this thread, to bind ntfn to
+extern seL4_CPtr tcb;
+// TIMER_MAX_PENDING empty slots to save the reply caps of sleeping clients
+extern seL4_CPtr replies;
 
 /* constants */
 #define EP_BADGE 61     // arbitrary (but unique) number for a badge
@@ -33,20 +44,273 @@ extern seL4_CPtr irq_handler;
 #define DEFAULT_TIMER_ID 0
 #define TTC0_TIMER1_IRQ 42
 
-int main(void)
+/* badge of ntfn, above those of the clients. Interrupts arrive through
+ * the endpoint with this badge as ntfn is bound to our tcb. */
+#define IRQ_BADGE BIT(27)
+
+/* clients that can sleep at once, one saved reply cap each */
+#define TIMER_MAX_PENDING 64
+
+/* deadlines this close together expire in the same batch */
+#define TIMER_SLACK_NS (50 * NS_IN_US)
+
+/* lengths of the two timeouts that calibrate the clock, both inside one
+ * wrap of it */
+#define TIMER_CALIBRATE_SHORT_NS (200 * NS_IN_US)
+#define TIMER_CALIBRATE_LONG_NS (2 * NS_IN_MS)
+
+/* timeouts in the load test */
+#define LOAD_TIMEOUTS 4096
+
+#ifdef TIMER_POLL
+/*
+ * Polled mode, for a timer on a core of its own. Rather than block for an
+ * interrupt, the timer spins reading the TTC's interrupt register, with the
+ * device interrupt disabled. It checks the endpoint for clients every
+ * TIMER_POLL_INTERVAL rounds. It only blocks once no timeout is armed and
+ * nothing has happened for TIMER_POLL_IDLE_NS.
+ */
+#define TIMER_POLL_CORE 1
+#define TIMER_POLL_INTERVAL 64
+#define TIMER_POLL_IDLE_NS (10 * NS_IN_MS)
+
+/* the interrupt register is cleared by reading it */
+#define TTC_ISR(id) (0x54 + 4 * (id))
+#define TTC_IER(id) (0x60 + 4 * (id))
+#define TTC_INT_ALL MASK(6)
+
+/* not a real badge, marks events found by polling */
+#define POLL_BADGE BIT(26)
+#endif
+
+/* per timer registers of a TTC, from the Zynq-7000 TRM */
+#define TTC_CLK_CTRL(id) (0x00 + 4 * (id))
+#define TTC_CNT_CTRL(id) (0x0C + 4 * (id))
+#define TTC_CNT_VAL(id) (0x18 + 4 * (id))
+#define TTC_CLK_PS_EN BIT(0)
+#define TTC_CLK_PS_SHIFT 1
+#define TTC_CNT_RST BIT(4)
+#define TTC_CNT_WAVE_DIS BIT(5)
+#define TTC_COUNTER_BITS 16
+
+/* the TTC timer that keeps the time, next to the one the driver uses for
+ * timeouts, counting up at the bus clock divided by 2^(CLOCK_PRESCALE + 1):
+ * about 72ns a tick, wrapping every 4.7ms. Timeout latencies are taken on
+ * it, so a tick must be well under the microseconds they are judged in. */
+#define CLOCK_TIMER_ID 1
+#define CLOCK_PRESCALE 2
+
+/* the longest timeout the driver has accepted so far. The counter cannot
+ * reach every deadline in one go, so a timeout it rejects is halved until it
+ * fits and longer waits are chained from timeouts of this length. */
+static uint64_t max_timeout_ns = UINT64_MAX;
+
+static volatile uint32_t *ttc_reg(uintptr_t offset)
 {
-    /* wait for a message */
-    seL4_Word sender_badge;
-    seL4_MessageInfo_t tag = seL4_Recv(endpoint, &sender_badge);
+    return (volatile uint32_t *)(timer_vaddr + offset);
+}
+
+/*
+ * The time is kept by a second TTC timer left counting freely, calibrated
+ * against timeouts from the driver at start. Unlike the cycle counter, it
+ * keeps counting while the core sleeps in WFI. Its counter is 16 bits, so it
+ * is never left longer than half a wrap without being read.
+ */
+static uint64_t ticks_per_s;
+static uint64_t clock_max_ns = UINT64_MAX;
+static uint16_t clock_last;
+static uint64_t clock_ticks;
+
+static uint16_t clock_read(void)
+{
+    return *ttc_reg(TTC_CNT_VAL(CLOCK_TIMER_ID));
+}
+
+static uint64_t ticks_to_ns(uint64_t ticks)
+{
+    return ticks / ticks_per_s * NS_IN_S + ticks % ticks_per_s * NS_IN_S / ticks_per_s;
+}
+
+/* ns since the clock started */
+static uint64_t clock_now(void)
+{
+    uint16_t now = clock_read();
+    clock_ticks += (uint16_t)(now - clock_last);
+    clock_last = now;
+    return ticks_to_ns(clock_ticks);
+}
+
+/* program a single one-shot timeout of up to remaining ns, returning the
+ * length programmed */
+static uint64_t program_timeout(timer_drv_t *timer_drv, uint64_t remaining)
+{
+    uint64_t ns = MIN(remaining, MIN(max_timeout_ns, clock_max_ns));
+    while (timer_set_timeout(timer_drv, ns, false) != 0) {
+        ZF_LOGF_IF(ns <= NS_IN_MS, "Failed to set timeout");
+        ns /= 2;
+        max_timeout_ns = ns;
+    }
+    return ns;
+}
+
+/* clock ticks to wait out a timeout of up to ns, setting ns to the length
+ * waited. Both timeouts are well short of a wrap of the counter. */
+static uint16_t time_timeout(timer_drv_t *timer_drv, uint64_t *ns)
+{
+    uint16_t start = clock_read();
+    *ns = program_timeout(timer_drv, *ns);
+    seL4_Wait(ntfn, NULL);
+    uint16_t ticks = clock_read() - start;
+    timer_handle_irq(timer_drv);
+    seL4_Error error = seL4_IRQHandler_Ack(irq_handler);
+    ZF_LOGF_IF(error, "Failed to ack irq");
+    return ticks;
+}
+
+/* start the clock, and time two timeouts with it. Taking the difference
+ * cancels out the cost of programming the timer and taking the interrupt. */
+static void calibrate(timer_drv_t *timer_drv)
+{
+    *ttc_reg(TTC_CLK_CTRL(CLOCK_TIMER_ID)) = TTC_CLK_PS_EN | (CLOCK_PRESCALE << TTC_CLK_PS_SHIFT);
+    /* enabled, counting up to the overflow with no waveform output */
+    *ttc_reg(TTC_CNT_CTRL(CLOCK_TIMER_ID)) = TTC_CNT_RST | TTC_CNT_WAVE_DIS;
+
+    uint64_t short_ns = TIMER_CALIBRATE_SHORT_NS;
+    uint64_t long_ns = TIMER_CALIBRATE_LONG_NS;
+    uint16_t short_ticks = time_timeout(timer_drv, &short_ns);
+    uint16_t long_ticks = time_timeout(timer_drv, &long_ns);
+    ZF_LOGF_IF(long_ns <= short_ns || long_ticks <= short_ticks, "Failed to calibrate the clock");
+
+    ticks_per_s = MAX((uint64_t)(long_ticks - short_ticks) * NS_IN_S / (long_ns - short_ns), 1);
+    clock_max_ns = ticks_to_ns(BIT(TTC_COUNTER_BITS - 1));
+    clock_last = clock_read();
+    printf("timer: clock at %llu ticks per s\n", (unsigned long long) ticks_per_s);
+}
+
+/* cost of adding LOAD_TIMEOUTS timeouts to the heap, then expiring them in
+ * deadline order a batch at a time as the server does */
+static void load_test(void)
+{
+    static timeout_t entries[LOAD_TIMEOUTS];
+    timeout_heap_t heap;
+    timeout_heap_init(&heap, entries, LOAD_TIMEOUTS);
+
+    /* deadlines spread over 10s, from a simple LCG */
+    uint32_t seed = 1;
+    ccnt_t start = sel4bench_get_cycle_count();
+    for (int i = 0; i < LOAD_TIMEOUTS; i++) {
+        seed = seed * 1103515245 + 12345;
+        ZF_LOGF_IF(!timeout_heap_push(&heap, (seed >> 8) % (10 * NS_IN_S), i), "Heap full");
+    }
+    ccnt_t insert = sel4bench_get_cycle_count() - start;
+
+    int batches = 0;
+    start = sel4bench_get_cycle_count();
+    for (uint64_t now = 0; !timeout_heap_empty(&heap); now += NS_IN_MS) {
+        if (timeout_heap_next(&heap) <= now) {
+            batches++;
+        }
+        while (timeout_heap_next(&heap) <= now) {
+            timeout_heap_pop(&heap);
+        }
+    }
+    ccnt_t expire = sel4bench_get_cycle_count() - start;
+
+    printf("timer: %d timeouts, %llu cycles per insert, %llu cycles per expiry in %d batches\n",
+           LOAD_TIMEOUTS, (unsigned long long) insert / LOAD_TIMEOUTS,
+           (unsigned long long) expire / LOAD_TIMEOUTS, batches);
+}
+
+#ifdef TIMER_POLL
+/* spin until the timer fires or a message arrives. Returns POLL_BADGE in
+ * badge for the timer. Blocks instead if nothing comes for
+ * TIMER_POLL_IDLE_NS while armed is clear. */
+static seL4_MessageInfo_t poll_event(bool armed, seL4_Word *badge)
+{
+    uint32_t ier = *ttc_reg(TTC_IER(DEFAULT_TIMER_ID));
+    *ttc_reg(TTC_IER(DEFAULT_TIMER_ID)) = 0;
+    uint64_t start = clock_now();
+    seL4_MessageInfo_t info;
 
-    /* make sure the message is what we expected */
-    assert(sender_badge == EP_BADGE);
-    assert(seL4_MessageInfo_get_length(tag) == 1);
+    for (uint64_t round = 1;; round++) {
+        if (*ttc_reg(TTC_ISR(DEFAULT_TIMER_ID)) & TTC_INT_ALL) {
+            *ttc_reg(TTC_IER(DEFAULT_TIMER_ID)) = ier;
+            *badge = POLL_BADGE;
+            return seL4_MessageInfo_new(0, 0, 0, 0);
+        }
+        if (round % TIMER_POLL_INTERVAL == 0) {
+            /* the badge is 0 if there was no message */
+            info = seL4_NBRecv(endpoint, badge);
+            if (*badge != 0) {
+                *ttc_reg(TTC_IER(DEFAULT_TIMER_ID)) = ier;
+                return info;
+            }
+            if (!armed && clock_now() - start > TIMER_POLL_IDLE_NS) {
+                break;
+            }
+        }
+    }
 
-    /* get the message stored in the first message register */
-    seL4_Word msg = seL4_GetMR(0);
-    printf("timer: got a message from %u to sleep %zu seconds\n", sender_badge, msg);
+    /* anything from here on raises the interrupt */
+    *ttc_reg(TTC_IER(DEFAULT_TIMER_ID)) = ier;
+    return seL4_Recv(endpoint, badge);
+}
+#endif
 
+/* reply to the caller of the last message if reply is set, with MR 0 already
+ * set, then wait for the next message or timer interrupt */
+static seL4_MessageInfo_t next_event(bool reply, bool armed, seL4_Word *badge)
+{
+#ifdef TIMER_POLL
+    if (reply) {
+        seL4_Reply(seL4_MessageInfo_new(0, 0, 0, 1));
+    }
+    return poll_event(armed, badge);
+#else
+    if (reply) {
+        return seL4_ReplyRecv(endpoint, seL4_MessageInfo_new(0, 0, 0, 1), badge);
+    }
+    return seL4_Recv(endpoint, badge);
+#endif
+}
+
+/* sleeping clients, by the index of the slot their reply cap is saved in */
+static timeout_t pending[TIMER_MAX_PENDING];
+static timeout_heap_t sleepers;
+static seL4_Word free_replies[TIMER_MAX_PENDING];
+static int num_free;
+
+/* reply to every client due by now, in one batch */
+static int expire(uint64_t now)
+{
+    int woken = 0;
+    while (timeout_heap_next(&sleepers) <= now + TIMER_SLACK_NS) {
+        timeout_t sleeper = timeout_heap_pop(&sleepers);
+        seL4_SetMR(0, 0);
+        seL4_Send(replies + sleeper.id, seL4_MessageInfo_new(0, 0, 0, 1));
+        free_replies[num_free++] = sleeper.id;
+        woken++;
+    }
+    return woken;
+}
+
+/* save the reply cap of the client that just called us to sleep ns. Returns
+ * false if it could not be saved, so the client should get a reply now. */
+static bool add_sleeper(uint64_t now, uint64_t ns)
+{
+    if (num_free == 0) {
+        ZF_LOGE("Too many sleeping clients");
+        return false;
+    }
+    seL4_Word slot = free_replies[--num_free];
+    seL4_Error error = seL4_CNode_SaveCaller(cnode, replies + slot, seL4_WordBits);
+    ZF_LOGF_IFERR(error, "Failed to save reply cap");
+    ZF_LOGF_IF(!timeout_heap_push(&sleepers, now + ns, slot), "Heap full");
+    return true;
+}
+
+int main(void)
+{
     /* retype the device untyped into a frame */
     seL4_Error error = seL4_Untyped_Retype(device_untyped, seL4_ARM_SmallPageObject, 0,
                                            cnode, 0, 0, timer_frame, 1);
@@ -81,39 +345,118 @@ int main(void)
     error = seL4_IRQHandler_Ack(irq_handler);
     ZF_LOGF_IF(error, "Failed to ack irq");
 
-    timer_err = timer_set_timeout(&timer_drv, NS_IN_MS, true);
-    ZF_LOGF_IF(timer_err, "Failed to set timeout");
+#if defined(TIMER_POLL) && CONFIG_MAX_NUM_NODES > 1
+    /* before starting the cycle counter, as each core has its own */
+    error = seL4_TCB_SetAffinity(tcb, TIMER_POLL_CORE);
+    ZF_LOGF_IFERR(error, "Failed to move to core %d", TIMER_POLL_CORE);
+#endif
+    /* for the cycle counts in the load test and the latency histograms */
+    sel4bench_init();
+    calibrate(&timer_drv);
+    load_test();
 
-    int count = 0;
+    /* take interrupts through the endpoint along with the clients */
+    error = seL4_TCB_BindNotification(tcb, ntfn);
+    ZF_LOGF_IFERR(error, "Failed to bind notification");
+
+    timeout_heap_init(&sleepers, pending, TIMER_MAX_PENDING);
+    for (int i = 0; i < TIMER_MAX_PENDING; i++) {
+        free_replies[num_free++] = i;
+    }
+
+    /* serve clients forever, keeping a one-shot timeout aimed at the earliest
+       deadline. Rather than a periodic tick, there is only an interrupt for
+       each timeout in the chain to the next deadline. */
+    uint64_t programmed_for = UINT64_MAX;
+    /* how late each timeout is seen in ns, through an interrupt or by
+       polling, and cycles from then to the ack */
+    bench_latency_t irq_latency, poll_latency, handling;
+    bench_latency_init(&irq_latency);
+    bench_latency_init(&poll_latency);
+    bench_latency_init(&handling);
+    int wakeups = 0;
+    int timeouts = 0;
+    seL4_Word sender_badge;
+    seL4_MessageInfo_t tag = next_event(false, false, &sender_badge);
     while (1)
     {
-        /* Handle the timer interrupt */
-        seL4_Word badge;
-        seL4_Wait(ntfn, &badge);
-        timer_handle_irq(&timer_drv);
-        if (count == 0)
+        bool reply = false;
+#ifdef TIMER_POLL
+        if (sender_badge == POLL_BADGE)
         {
-            printf("Tick\n");
+            /* the timer fired without raising its interrupt */
+            ccnt_t woken_at = sel4bench_get_cycle_count();
+            bench_latency_record(&poll_latency, programmed_for, clock_now());
+            wakeups++;
+            timer_handle_irq(&timer_drv);
+            bench_latency_record(&handling, woken_at, sel4bench_get_cycle_count());
+            programmed_for = UINT64_MAX;
         }
+        else
+#endif
+        if (sender_badge & IRQ_BADGE)
+        {
+            /* Handle the timer interrupt */
+            ccnt_t woken_at = sel4bench_get_cycle_count();
+            if (programmed_for != UINT64_MAX)
+            {
+                bench_latency_record(&irq_latency, programmed_for, clock_now());
+            }
+            wakeups++;
+            timer_handle_irq(&timer_drv);
+            if (wakeups == 1)
+            {
+                printf("Tick\n");
+            }
 
-        /* TODO ack the interrupt */
-        error = seL4_IRQHandler_Ack(irq_handler);
-        ZF_LOGF_IF(error, "Failed");
-        count++;
-        if (count == 1000 * msg)
+            /* TODO ack the interrupt */
+            error = seL4_IRQHandler_Ack(irq_handler);
+            ZF_LOGF_IF(error, "Failed");
+            bench_latency_record(&handling, woken_at, sel4bench_get_cycle_count());
+            programmed_for = UINT64_MAX;
+        }
+        else
         {
-            break;
+            /* make sure the message is what we expected */
+            assert(seL4_MessageInfo_get_length(tag) == 1);
+
+            /* get the message stored in the first message register */
+            seL4_Word msg = seL4_GetMR(0);
+            printf("timer: got a message from %u to sleep %zu seconds\n", sender_badge, msg);
+            reply = !add_sleeper(clock_now(), msg * NS_IN_S);
         }
-    }
 
-    // stop the timer
-    timer_stop(&timer_drv);
+        uint64_t now = clock_now();
+        int woken = expire(now);
+        if (woken > 0)
+        {
+            printf("timer: woke %d clients after %d wakeups for %d timeouts\n", woken, wakeups, timeouts);
+            if (timeout_heap_empty(&sleepers))
+            {
+                bench_latency_print("timer: irq latency", "ns", &irq_latency, true);
+#ifdef TIMER_POLL
+                bench_latency_print("timer: poll latency", "ns", &poll_latency, true);
+#endif
+                bench_latency_print("timer: irq to ack", "cycles", &handling, false);
+            }
+        }
 
-    /* modify the message */
-    seL4_SetMR(0, 0);
+        /* the timeout in flight ends after the earliest deadline, or has
+           fired, so aim a new one at the deadline */
+        uint64_t next = timeout_heap_next(&sleepers);
+        if (next < programmed_for || programmed_for == UINT64_MAX)
+        {
+            uint64_t ns = program_timeout(&timer_drv, next > now ? next - now : 0);
+            programmed_for = now + ns;
+            timeouts++;
+        }
 
-    /* send the modified message back */
-    seL4_ReplyRecv(endpoint, tag, &sender_badge);
+        if (reply)
+        {
+            seL4_SetMR(0, 0);
+        }
+        tag = next_event(reply, !timeout_heap_empty(&sleepers), &sender_badge);
+    }
 
     return 0;
-}
\ No newline at end of file
+}
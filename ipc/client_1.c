@@ -2,14 +2,31 @@
 
 #include <assert.h>
 #include <stdio.h>
+#include <string.h>
 #include <sel4/sel4.h>
 #include <utils/util.h>
+#include <sel4bench/sel4bench.h>
+
+#include "msg.h"
+#include "ring.h"
 
 extern seL4_CPtr endpoint;
 extern seL4_CPtr cnode;
 extern seL4_CPtr badged_endpoint;
+// frame shared with the server for payloads too long for registers
+extern char shared_buf[MSG_SHARED_SIZE];
+// notification to wake the server after queueing submissions, and the one the
+// server signals after posting completions
+extern seL4_CPtr ring_ntfn;
+extern seL4_CPtr ring_done;
+// submission and completion rings shared with the server
+extern char ring_buf[BIT(seL4_PageBits)];
+
+/* requests sent down each path when comparing the two */
+#define SMALL_REQUESTS 1000
 
-const char *messages[] = {"quick", "fox", "over", "lazy"};
+const char *messages[] = {"quick", "fox", "over", "lazy",
+                          "the quick brown fox jumps over the lazy dog"};
 
 int main(int c, char *argv[]) {
 
@@ -24,13 +41,54 @@ int main(int c, char *argv[]) {
     /* wait for the server to send us an endpoint */
     printf("Client %d: received badged endpoint\n", id);
 
+    /* time each round trip to the server with the cycle counter */
+    sel4bench_init();
+    ccnt_t total = 0;
     for (int i = 0; i < ARRAY_SIZE(messages); i++) {
-        int j;
-        for (j = 0; messages[i][j] != '\0'; j++) {
-            seL4_SetMR(j, messages[i][j]);
-        }
-        info = seL4_MessageInfo_new(0, 0, 0, j);
+        info = msg_encode(messages[i], strlen(messages[i]), shared_buf);
+        ccnt_t start = sel4bench_get_cycle_count();
+        seL4_Call(badged_endpoint, info);
+        total += sel4bench_get_cycle_count() - start;
+    }
+    printf("Client %d: %zu round trips, %llu cycles/round trip\n", id,
+           ARRAY_SIZE(messages), (unsigned long long)(total / ARRAY_SIZE(messages)));
+
+    /* small requests one seL4_Call at a time... */
+    info = seL4_MessageInfo_new(MSG_LABEL_NOP, 0, 0, 0);
+    ccnt_t start = sel4bench_get_cycle_count();
+    for (int i = 0; i < SMALL_REQUESTS; i++) {
         seL4_Call(badged_endpoint, info);
     }
+    ccnt_t sync = sel4bench_get_cycle_count() - start;
+
+    /* ...and in batches on the ring, waking the server once per batch. At
+     * most RING_ENTRIES are in flight, so neither ring can overflow. */
+    ipc_ring_t *ring = (ipc_ring_t *) ring_buf;
+    int submitted = 0;
+    int completed = 0;
+    start = sel4bench_get_cycle_count();
+    while (completed < SMALL_REQUESTS) {
+        int queued = 0;
+        while (submitted < SMALL_REQUESTS && submitted - completed < RING_ENTRIES) {
+            ring_sqe_t sqe = {.user_data = submitted, .op = RING_OP_NOP, .arg = submitted};
+            ZF_LOGF_IF(!ring_submit(ring, sqe), "Submission ring full");
+            submitted++;
+            queued++;
+        }
+        if (queued > 0) {
+            seL4_Signal(ring_ntfn);
+        }
+        seL4_Wait(ring_done, NULL);
+        ring_cqe_t cqe;
+        while (ring_reap(ring, &cqe)) {
+            assert(cqe.result == cqe.user_data);
+            completed++;
+        }
+    }
+    ccnt_t async = sel4bench_get_cycle_count() - start;
+    printf("Client %d: %d small requests, %llu cycles/request with seL4_Call, %llu on the ring\n",
+           id, SMALL_REQUESTS, (unsigned long long)(sync / SMALL_REQUESTS),
+           (unsigned long long)(async / SMALL_REQUESTS));
+    sel4bench_destroy();
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,50 @@
+#include <assert.h>
+#include <string.h>
+#include <sel4/sel4.h>
+#include <utils/util.h>
+
+#include "msg.h"
+
+seL4_MessageInfo_t msg_encode(const char *data, size_t len, char *shared)
+{
+    assert(len <= MSG_MAX);
+
+    if (len > MSG_INLINE_MAX) {
+        /* too long for the fastpath registers: spill to the shared frame */
+        memcpy(shared, data, len);
+        return seL4_MessageInfo_new(len, 0, 0, 0);
+    }
+
+    size_t words = DIV_ROUND_UP(len, sizeof(seL4_Word));
+    for (size_t i = 0; i < words; i++) {
+        seL4_Word w = 0;
+        memcpy(&w, data + i * sizeof(seL4_Word), MIN(sizeof(seL4_Word), len - i * sizeof(seL4_Word)));
+        seL4_SetMR(i, w);
+    }
+    return seL4_MessageInfo_new(len, 0, 0, words);
+}
+
+size_t msg_decode(seL4_MessageInfo_t info, char *dst, const char *shared)
+{
+    size_t len = seL4_MessageInfo_get_label(info);
+    if (len > MSG_MAX) {
+        ZF_LOGE("Message length %zu too long", len);
+        return 0;
+    }
+
+    if (len > MSG_INLINE_MAX) {
+        memcpy(dst, shared, len);
+        return len;
+    }
+
+    size_t words = seL4_MessageInfo_get_length(info);
+    if (words * sizeof(seL4_Word) < len) {
+        ZF_LOGE("Message of %zu bytes sent in only %zu words", len, words);
+        return 0;
+    }
+    for (size_t i = 0; i < DIV_ROUND_UP(len, sizeof(seL4_Word)); i++) {
+        seL4_Word w = seL4_GetMR(i);
+        memcpy(dst + i * sizeof(seL4_Word), &w, MIN(sizeof(seL4_Word), len - i * sizeof(seL4_Word)));
+    }
+    return len;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stddef.h>
+#include <sel4/sel4.h>
+
+/*
+ * Marshalling for the byte strings the clients send to the server.
+ *
+ * The label of a message carries the payload length in bytes. Payloads that
+ * fit in the fastpath message registers are packed a full word per register.
+ * Anything longer is copied into the shared frame between that client and the
+ * server, and the message itself carries no registers at all. Either way the
+ * IPC stays on the fastpath.
+ */
+
+/* size of the frame shared between each client and the server */
+#define MSG_SHARED_SIZE 4096
+
+/* payloads up to this many bytes are sent in message registers */
+#define MSG_INLINE_MAX (seL4_FastMessageRegisters * sizeof(seL4_Word))
+
+/* largest payload that can be sent at all */
+#define MSG_MAX MSG_SHARED_SIZE
+
+/* label of a request with no payload that the server replies to straight
+ * away, above any payload length */
+#define MSG_LABEL_NOP (MSG_MAX + 1)
+
+/* load len bytes of data into the message registers, or into shared if the
+ * payload does not fit. Returns the message info to send. */
+seL4_MessageInfo_t msg_encode(const char *data, size_t len, char *shared);
+
+/* copy the payload of a received message into dst, which must have room for
+ * MSG_MAX bytes. Returns the payload length in bytes. */
+size_t msg_decode(seL4_MessageInfo_t info, char *dst, const char *shared);
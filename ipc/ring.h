@@ -0,0 +1,110 @@
+#pragma once
+
+#include <stdbool.h>
+#include <sel4/sel4.h>
+#include <utils/util.h>
+
+/*
+ * Asynchronous submission and completion rings shared between one client and
+ * the server, in the style of io_uring.
+ *
+ * The client fills submission entries and signals its badged ring_ntfn cap
+ * once for the whole batch. The server drains every submission it finds,
+ * posts a completion for each, and signals the client's ring_done once per
+ * drain.
+ * Notifications are sticky, so a signal sent while the other side is busy is
+ * seen on its next wait. Each side only writes the indices it owns: the
+ * client owns sq_tail and cq_head, the server sq_head and cq_tail.
+ */
+
+/* entries in each ring, a power of two */
+#define RING_ENTRIES 64
+
+/* the server's notification badge for client id, above every endpoint badge */
+#define RING_BADGE_SHIFT 8
+#define RING_BADGE(id) BIT(RING_BADGE_SHIFT + (id))
+
+/* complete immediately with arg as the result */
+#define RING_OP_NOP 0
+
+typedef struct {
+    seL4_Word user_data;
+    seL4_Word op;
+    seL4_Word arg;
+} ring_sqe_t;
+
+typedef struct {
+    seL4_Word user_data;
+    seL4_Word result;
+} ring_cqe_t;
+
+/* keep each index on its own cache line so the two sides do not share one */
+typedef struct {
+    seL4_Word value;
+} ALIGN(64) ring_index_t;
+
+typedef struct {
+    ring_index_t sq_head;
+    ring_index_t sq_tail;
+    ring_index_t cq_head;
+    ring_index_t cq_tail;
+    ring_sqe_t sq[RING_ENTRIES];
+    ring_cqe_t cq[RING_ENTRIES];
+} ipc_ring_t;
+
+compile_time_assert(ring_fits_in_frame, sizeof(ipc_ring_t) <= BIT(seL4_PageBits));
+
+static inline seL4_Word ring_load(ring_index_t *index)
+{
+    return __atomic_load_n(&index->value, __ATOMIC_ACQUIRE);
+}
+
+static inline void ring_store(ring_index_t *index, seL4_Word value)
+{
+    __atomic_store_n(&index->value, value, __ATOMIC_RELEASE);
+}
+
+/* client: queue a submission. Returns false if the ring is full. */
+static inline bool ring_submit(ipc_ring_t *ring, ring_sqe_t sqe)
+{
+    seL4_Word tail = ring->sq_tail.value;
+    if (tail - ring_load(&ring->sq_head) == RING_ENTRIES) {
+        return false;
+    }
+    ring->sq[tail % RING_ENTRIES] = sqe;
+    ring_store(&ring->sq_tail, tail + 1);
+    return true;
+}
+
+/* client: take the next completion. Returns false if there is none. */
+static inline bool ring_reap(ipc_ring_t *ring, ring_cqe_t *cqe)
+{
+    seL4_Word head = ring->cq_head.value;
+    if (head == ring_load(&ring->cq_tail)) {
+        return false;
+    }
+    *cqe = ring->cq[head % RING_ENTRIES];
+    ring_store(&ring->cq_head, head + 1);
+    return true;
+}
+
+/* server: take the next submission, if there is one and room to complete it */
+static inline bool ring_next_sqe(ipc_ring_t *ring, ring_sqe_t *sqe)
+{
+    seL4_Word head = ring->sq_head.value;
+    if (head == ring_load(&ring->sq_tail) ||
+        ring->cq_tail.value - ring_load(&ring->cq_head) == RING_ENTRIES) {
+        return false;
+    }
+    *sqe = ring->sq[head % RING_ENTRIES];
+    ring_store(&ring->sq_head, head + 1);
+    return true;
+}
+
+/* server: post a completion. ring_next_sqe has already checked there is room. */
+static inline void ring_complete(ipc_ring_t *ring, ring_cqe_t cqe)
+{
+    seL4_Word tail = ring->cq_tail.value;
+    ring->cq[tail % RING_ENTRIES] = cqe;
+    ring_store(&ring->cq_tail, tail + 1);
+}
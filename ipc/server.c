@@ -1,149 +1,263 @@
 
 
 #include <assert.h>
+#include <stdbool.h>
 #include <sel4/sel4.h>
 #include <stdio.h>
 #include <utils/util.h>
-#include <timer_driver/driver.h>
+
+#include <bench/thread.h>
+
+#include "msg.h"
+#include "ring.h"
+
+/* threads receiving on the endpoint, including the initial thread. The others
+ * are created at startup from the resources reserved in the capDL spec. */
+#define SERVER_NUM_WORKERS 4
+#define WORKER_STACK_SIZE 16384
 
 // cslot containing IPC endpoint capability
 extern seL4_CPtr endpoint;
 // cslot containing a capability to the cnode of the server
 extern seL4_CPtr cnode;
-// empty cslot
-extern seL4_CPtr free_slot;
+// first of BADGE_POOL_SIZE empty cslots for pre-minted badged endpoints
+extern seL4_CPtr badge_pool;
+// frames shared with each client for payloads too long for registers
+extern char client_1_buf[MSG_SHARED_SIZE];
+extern char client_2_buf[MSG_SHARED_SIZE];
+// notification bound to the server that clients signal after queueing
+// submissions, and the notifications to signal each client's completions on
+extern seL4_CPtr ring_ntfn;
+extern seL4_CPtr ring_done;
+// submission and completion rings shared with each client
+extern char client_1_ring[BIT(seL4_PageBits)];
+extern char client_2_ring[BIT(seL4_PageBits)];
+// VSpace and TCB of the server, to create worker threads with
+extern seL4_CPtr vspace;
+extern seL4_CPtr tcb;
+// untyped to retype the worker TCBs from, and the empty slots to put them in
+extern seL4_CPtr tcb_untyped;
+extern seL4_CPtr worker_tcbs;
+// IPC buffers of the workers, and the caps to their frames
+extern seL4_CPtr worker_ipc_frames;
+extern char worker_ipc_bufs[SERVER_NUM_WORKERS - 1][BIT(seL4_PageBits)];
+extern char worker_stacks[SERVER_NUM_WORKERS - 1][WORKER_STACK_SIZE];
+// notification used as a mutex between the workers
+extern seL4_CPtr server_lock;
 
-int main(int c, char *argv[])
+/* clients in the capDL spec, each registers once with its id */
+#define SERVER_NUM_CLIENTS 2
+
+/* highest badge the server will hand out to a client, one per client */
+#define MAX_CLIENT_BADGE SERVER_NUM_CLIENTS
+
+/* number of cslots starting at badge_pool, as reserved in the capDL spec */
+#define BADGE_POOL_SIZE SERVER_NUM_CLIENTS
+/* refill the pool once fewer than this many caps are ready */
+#define BADGE_POOL_LOW_WATER 1
+
+/* a handler services one message and returns the reply to send back */
+typedef seL4_MessageInfo_t (*handler_fn)(seL4_Word badge, seL4_MessageInfo_t info);
+
+static seL4_MessageInfo_t handle_register(seL4_Word badge, seL4_MessageInfo_t info);
+static seL4_MessageInfo_t handle_echo(seL4_Word badge, seL4_MessageInfo_t info);
+
+/* dispatch table indexed by the badge of the invoked endpoint. Badge 0 is the
+ * unbadged endpoint every client starts with, so it is used for registration.
+ * The slot for each client badge is filled in once that client registers. */
+static handler_fn handlers[MAX_CLIENT_BADGE + 1] = {
+    [0] = handle_register,
+};
+
+/* shared frame of each client, indexed by the id the client registers with */
+static char *const shared_bufs[SERVER_NUM_CLIENTS + 1] = {NULL, client_1_buf, client_2_buf};
+
+/* shared frame of each registered client, indexed by badge */
+static const char *client_bufs[MAX_CLIENT_BADGE + 1];
+
+/* rings of each client, indexed by client id. A client's ring is only
+ * drained once it has registered. */
+static ipc_ring_t *const shared_rings[SERVER_NUM_CLIENTS + 1] = {NULL, (ipc_ring_t *) client_1_ring, (ipc_ring_t *) client_2_ring};
+static bool ring_active[ARRAY_SIZE(shared_rings)];
+
+/*
+ * Pool of badged endpoint caps minted ahead of registration. The pool is a
+ * ring over the badge_pool cslots: pool_ready caps starting at pool_head are
+ * ready to hand out, the remaining slots hold caps already sent to clients
+ * (or nothing). Transferred caps are copies, so a handed out slot still holds
+ * the server's copy until the slot is minted over in the next refill.
+ */
+static seL4_Word pool_head;
+static seL4_Word pool_ready;
+static seL4_Word pool_badges[BADGE_POOL_SIZE];
+static seL4_Word next_badge = 1;
+
+/* serialises updates to the badge pool and handler tables between the
+ * workers. The notification holds one signal while the lock is free, so a
+ * contending worker blocks in the kernel rather than spinning against a
+ * worker of the same priority. */
+static void lock(void)
 {
-     seL4_Word sender;
-     seL4_MessageInfo_t info = seL4_Recv(endpoint, &sender);
-     error = ltimer_default_init(&timer, ops, NULL, NULL);
-     assert(error == 0);
-     while (1)
-     {
-          seL4_Error error;
-          if (sender == 0)
-          {
-               /* No badge! give this sender a badged copy of the endpoint */
-               seL4_Word badge = seL4_GetMR(0);
-               seL4_Error error = seL4_CNode_Mint(cnode, free_slot, seL4_WordBits,
-                                                  cnode, endpoint, seL4_WordBits,
-                                                  seL4_AllRights, badge);
-               printf("Badged %lu\n", badge);
-               // TODO use cap transfer to send the badged cap in the reply
-               info = seL4_MessageInfo_new(0, 0, 1, 0);
-               seL4_SetCap(0, free_slot);
-               /* reply to the sender and wait for the next message */
-               seL4_Reply(info);
-               /* now delete the transferred cap */
-               error = seL4_CNode_Delete(cnode, free_slot, seL4_WordBits);
-               assert(error == seL4_NoError);
-               /* wait for the next message */
-               info = seL4_Recv(endpoint, &sender);
-          }
-          else
-          {
-               // TODO use printf to print out the message sent by the client
-               // followed by a new line
-               seL4_CNode_SaveCaller(cnode, free_slot, seL4_WordBits);
-               info = seL4_Recv(endpoint, &sender);
-               for (int i = 0; i < seL4_MessageInfo_get_length(info); i++)
-               {
-                    printf("%c", (char)seL4_GetMR(i));
-               }
-               printf("\n");
-               seL4_Send(free_slot, seL4_MessageInfo_new(0, 0, 0, 0));
-          }
-     }
-     return 0;
+    seL4_Wait(server_lock, NULL);
 }
 
-static void *thread1_fn(void *arg)
+static void unlock(void)
 {
-     l4_msgtag_t tag;
-     int ipc_error;
-     unsigned long value = 1;
-     (void)arg;
-     while (1)
-     {
-          printf(”Sending
-                 : % ld\n”, value);
-          /* Store the value which we want to have squared in the first message
-       * register of our UTCB. */
-          l4_utcb_mr()->mr[0] = value;
-          /* To an L4 IPC call, i.e. send a message to thread2 and wait for a
-       * reply from thread2. The '1' in the msgtag denotes that we want to
-       * transfer one word of our message registers (i.e. MR0). No timeout. */
-          l4_calibrate_tsc(l4re_kip());
-          l4_cpu_time_t e = l4_rdtsc();
-          printf(”the CPU - internal start - time
-                 : % lld \n”, e);
-          tag = l4_ipc_call(pthread_l4_cap(t2), l4_utcb(),
-                            l4_msgtag(0, 1, 0, 0), L4_IPC_NEVER);
-          l4_cpu_time_t e2 = l4_rdtsc();
-          printf(”the CPU - internal end - time % lld\n”, e2);
-          printf(”the CPU - internal time % lld\n”, e2 - e);
-          /* Check for IPC error, if yes, print out the IPC error code, if not,
-          * print the received result. */
-          ipc_error = l4_ipc_error(tag, l4_utcb());
-          if (ipc_error)
-               fprintf(stderr, ”thread1
-                       : IPC error
-                       : % x\n”, ipc_error);
-          else
-               printf(”Received
-                      : % ld\n”, l4_utcb_mr()->mr[0]);
-          /* Wait some time and increment our value. */
-          sleep(1);
-          value++;
-     }
-     return NULL;
+    seL4_Signal(server_lock);
 }
 
-static void *thread2_fn(void *arg)
+/* mint badges into every free slot of the pool in one batch */
+static void badge_pool_refill(void)
 {
-     l4_msgtag_t tag;
-     l4_umword_t label;
-     int ipc_error;
-     (void)arg;
-     /* Wait for requests from any thread. No timeout, i.e. wait forever. */
-     tag = l4_ipc_wait(l4_utcb(), &label, L4_IPC_NEVER);
-     while (1)
-     {
-          /* Check if we had any IPC failure, if yes, print the error code
-       * and just wait again. */
-          ipc_error = l4_ipc_error(tag, l4_utcb());
-          if (ipc_error)
-          {
-               fprintf(stderr, ”thread2
-                       : IPC error
-                       : % x\n”, ipc_error);
-               tag = l4_ipc_wait(l4_utcb(), &label, L4_IPC_NEVER);
-               continue;
-          }
-          /* So, the IPC was ok, now take the value out of message register 0
-       * of the UTCB and store the square of it back to it. */
-          l4_utcb_mr()->mr[0] = 5308;
-          /* Send the reply and wait again for new messages.
-   * The '1' in the msgtag indicated that we want to transfer 1 word in
-   * the message registers (i.e. MR0) */
-          Empty();
-          tag = l4_ipc_reply_and_wait(l4_utcb(), l4_msgtag(0, 1, 0, 0),
-                                      &label, L4_IPC_NEVER);
-     }
-     return NULL;
+    while (pool_ready < BADGE_POOL_SIZE && next_badge <= MAX_CLIENT_BADGE) {
+        seL4_Word i = (pool_head + pool_ready) % BADGE_POOL_SIZE;
+        seL4_Error error = seL4_CNode_Delete(cnode, badge_pool + i, seL4_WordBits);
+        ZF_LOGF_IFERR(error, "Failed to clear badge pool slot");
+        error = seL4_CNode_Mint(cnode, badge_pool + i, seL4_WordBits,
+                                cnode, endpoint, seL4_WordBits,
+                                seL4_AllRights, next_badge);
+        ZF_LOGF_IFERR(error, "Failed to mint badged endpoint");
+        pool_badges[i] = next_badge;
+        next_badge++;
+        pool_ready++;
+    }
 }
 
-int main(void)
+static seL4_MessageInfo_t handle_register(seL4_Word badge, seL4_MessageInfo_t info)
 {
-     // We will have two threads, one is already running the main function, the
-     // other (thread2) will be created using pthread_create.
-     if (pthread_create(&t2, NULL, thread2_fn, NULL))
-     {
-          fprintf(stderr, ”Thread creation failed\n”);
-          return 1;
-     }
-     // Just run thread1 in the main thread
-     thread1_fn(NULL);
-     return 0;
+    /* No badge! give this sender a badged copy of the endpoint */
+    seL4_Word id = seL4_GetMR(0);
+    if (id == 0 || id >= ARRAY_SIZE(shared_bufs)) {
+        ZF_LOGE("Invalid client id %lu", id);
+        return seL4_MessageInfo_new(0, 0, 0, 0);
+    }
+
+    lock();
+    if (ring_active[id]) {
+        unlock();
+        ZF_LOGE("Client %lu is already registered", id);
+        return seL4_MessageInfo_new(0, 0, 0, 0);
+    }
+    if (pool_ready < BADGE_POOL_LOW_WATER) {
+        badge_pool_refill();
+    }
+    if (pool_ready == 0) {
+        unlock();
+        ZF_LOGE("Out of badges for client %lu", id);
+        return seL4_MessageInfo_new(0, 0, 0, 0);
+    }
+
+    seL4_CPtr slot = badge_pool + pool_head;
+    seL4_Word new_badge = pool_badges[pool_head];
+    pool_head = (pool_head + 1) % BADGE_POOL_SIZE;
+    pool_ready--;
+
+    /* the handler is in place before the client can use the badge, as the
+     * client only receives it in the reply */
+    handlers[new_badge] = handle_echo;
+    client_bufs[new_badge] = shared_bufs[id];
+    ring_active[id] = true;
+    unlock();
+
+    printf("Badged %lu\n", new_badge);
+
+    /* use cap transfer to send the badged cap in the reply */
+    seL4_SetCap(0, slot);
+    return seL4_MessageInfo_new(0, 0, 1, 0);
+}
+
+static seL4_MessageInfo_t handle_echo(seL4_Word badge, seL4_MessageInfo_t info)
+{
+    if (seL4_MessageInfo_get_label(info) == MSG_LABEL_NOP) {
+        return seL4_MessageInfo_new(0, 0, 0, 0);
+    }
+
+    char buf[MSG_MAX];
+    size_t len = msg_decode(info, buf, client_bufs[badge]);
+    printf("%.*s\n", (int)len, buf);
+    return seL4_MessageInfo_new(0, 0, 0, 0);
+}
+
+/* complete every submission queued on the ring of client id, then wake the
+ * client once for the whole batch */
+static void ring_drain(seL4_Word id)
+{
+    ipc_ring_t *ring = shared_rings[id];
+    ring_sqe_t sqe;
+    int completed = 0;
+    while (ring_next_sqe(ring, &sqe)) {
+        ring_cqe_t cqe = {.user_data = sqe.user_data};
+        switch (sqe.op) {
+        case RING_OP_NOP:
+            cqe.result = sqe.arg;
+            break;
+        default:
+            ZF_LOGE("Unknown ring op %lu from client %lu", sqe.op, id);
+            cqe.result = -1;
+            break;
+        }
+        ring_complete(ring, cqe);
+        completed++;
+    }
+    if (completed > 0) {
+        seL4_Signal(ring_done + id - 1);
+    }
+}
+
+/* the event loop run by every worker */
+static void serve(void)
+{
+    seL4_Word sender;
+    seL4_MessageInfo_t info = seL4_Recv(endpoint, &sender);
+    while (1) {
+        seL4_MessageInfo_t reply;
+        if (sender > MAX_CLIENT_BADGE) {
+            /* a signal on the bound ring notification: the badge has a bit
+             * set for each client that queued submissions */
+            for (seL4_Word id = 1; id < ARRAY_SIZE(shared_rings); id++) {
+                if ((sender & RING_BADGE(id)) && ring_active[id]) {
+                    ring_drain(id);
+                }
+            }
+            /* there is no caller to reply to */
+            reply = seL4_MessageInfo_new(0, 0, 0, 0);
+        } else if (handlers[sender] != NULL) {
+            reply = handlers[sender](sender, info);
+        } else {
+            ZF_LOGE("No handler for badge %lu", sender);
+            reply = seL4_MessageInfo_new(0, 0, 0, 0);
+        }
+        /* reply to the sender and wait for the next message in one syscall,
+         * which keeps the steady-state echo path on the fastpath */
+        info = seL4_ReplyRecv(endpoint, reply, &sender);
+    }
+}
+
+/* workers created at startup. The initial thread is worker 0 and stays on
+ * core 0. */
+static bench_thread_t workers[SERVER_NUM_WORKERS - 1];
+
+int main(int c, char *argv[])
+{
+    badge_pool_refill();
+
+    /* ring submissions arrive through the endpoint loop of this thread */
+    seL4_Error error = seL4_TCB_BindNotification(tcb, ring_ntfn);
+    ZF_LOGF_IFERR(error, "Failed to bind ring notification");
+
+    /* the lock starts out free */
+    seL4_Signal(server_lock);
+
+    for (int i = 0; i < SERVER_NUM_WORKERS - 1; i++) {
+        workers[i] = (bench_thread_t) {
+            .tcb = worker_tcbs + i,
+            .ipc_frame = worker_ipc_frames + i,
+            .ipc_buf = (seL4_IPCBuffer *) worker_ipc_bufs[i],
+            .stack_top = (uintptr_t) worker_stacks[i] + WORKER_STACK_SIZE,
+        };
+        bench_thread_create(&workers[i], tcb_untyped, cnode, vspace, tcb, 254);
+        bench_thread_start(&workers[i], (i + 1) % CONFIG_MAX_NUM_NODES, serve, NULL, NULL);
+    }
+    serve();
+    return 0;
 }
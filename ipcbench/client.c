@@ -0,0 +1,203 @@
+#include <stdio.h>
+#include <sel4/sel4.h>
+#include <sel4runtime.h>
+#include <sel4runtime/gen_config.h>
+#include <utils/util.h>
+#include <sel4utils/util.h>
+#include <sel4utils/helpers.h>
+#include <sel4bench/sel4bench.h>
+
+#include <bench/stats.h>
+#include <bench/thread.h>
+
+#include "ipcbench.h"
+
+// endpoint served by the server process
+extern seL4_CPtr endpoint;
+// endpoint served by the thread started in this address space
+extern seL4_CPtr local_ep;
+// cap the local thread sends back when asked for a cap transfer
+extern seL4_CPtr transfer_ntfn;
+// the CSpace, VSpace and TCB of this process
+extern seL4_CPtr cnode;
+extern seL4_CPtr vspace;
+extern seL4_CPtr tcb;
+// untyped to create the thread TCBs from, and the slot for the local thread's
+extern seL4_CPtr tcb_untyped;
+extern seL4_CPtr thread_tcb;
+// IPC buffer of the local thread, and the cap to its frame
+extern seL4_CPtr thread_ipc_frame;
+extern char thread_ipc_buf[4096];
+extern char thread_stack[65536];
+// endpoint served by the throughput workers of the server process
+extern seL4_CPtr tput_ep;
+// signalled by each load thread when it has made all of its calls
+extern seL4_CPtr done_ntfn;
+// slots, IPC buffers and stacks of the load threads
+extern seL4_CPtr load_tcbs;
+extern seL4_CPtr load_ipc_frames;
+extern char load_ipc_bufs[IPCBENCH_LOAD_THREADS][BIT(seL4_PageBits)];
+extern char load_stacks[IPCBENCH_LOAD_THREADS][IPCBENCH_STACK_SIZE];
+// TCB of the server process, to move it between cores
+extern seL4_CPtr server_tcb;
+// empty slot to receive transferred caps in
+extern seL4_CPtr recv_slot;
+
+#define WARMUP_ITERATIONS 100
+#define SAMPLES 1000
+/* calls made by each load thread in a throughput run */
+#define TPUT_CALLS 10000
+
+/* message lengths to measure, in message registers */
+static const seL4_Word lengths[] = {0, 1, 2, 3, 4, 5, 8, 16, 32, 64, seL4_MsgMaxLength};
+
+static ccnt_t samples[SAMPLES];
+
+static bench_thread_t local_thread;
+static bench_thread_t load_threads[IPCBENCH_LOAD_THREADS];
+
+/* number of load threads done with the current throughput run */
+static volatile seL4_Word load_done;
+
+static void local_server(void)
+{
+    seL4_Word badge;
+    seL4_MessageInfo_t info = seL4_Recv(local_ep, &badge);
+    while (1) {
+        info = seL4_ReplyRecv(local_ep, ipcbench_reply(info, transfer_ntfn), &badge);
+    }
+}
+
+/* start a thread in this address space that serves local_ep */
+static void start_local_server(void)
+{
+    local_thread = (bench_thread_t) {
+        .tcb = thread_tcb,
+        .ipc_frame = thread_ipc_frame,
+        .ipc_buf = (seL4_IPCBuffer *) thread_ipc_buf,
+        .stack_top = (uintptr_t) thread_stack + sizeof(thread_stack),
+    };
+    /* run at the same priority as this thread, like the server process */
+    bench_thread_create(&local_thread, tcb_untyped, cnode, vspace, tcb, 254);
+    bench_thread_start(&local_thread, 0, local_server, NULL, NULL);
+}
+
+static void measure(const char *scenario, seL4_CPtr ep, seL4_Word length, bool cap)
+{
+    seL4_MessageInfo_t info = seL4_MessageInfo_new(cap ? IPCBENCH_LABEL_CAP : 0, 0, 0, length);
+    for (int i = 0; i < WARMUP_ITERATIONS + SAMPLES; i++) {
+        ccnt_t start = sel4bench_get_cycle_count();
+        seL4_Call(ep, info);
+        ccnt_t end = sel4bench_get_cycle_count();
+        if (cap) {
+            /* clear the receive slot for the next transfer */
+            seL4_Error error = seL4_CNode_Delete(cnode, recv_slot, seL4_WordBits);
+            ZF_LOGF_IFERR(error, "Failed to delete transferred cap");
+        }
+        if (i >= WARMUP_ITERATIONS) {
+            samples[i - WARMUP_ITERATIONS] = end - start;
+        }
+    }
+
+    char name[48];
+    snprintf(name, sizeof(name), "%s len %lu%s", scenario, (unsigned long) length, cap ? " cap" : "");
+    bench_stats_print(name, samples, SAMPLES);
+}
+
+static void run(const char *scenario, seL4_CPtr ep)
+{
+    for (int i = 0; i < ARRAY_SIZE(lengths); i++) {
+        measure(scenario, ep, lengths[i], false);
+        measure(scenario, ep, lengths[i], true);
+    }
+}
+
+static void load_thread(seL4_CPtr self)
+{
+    seL4_MessageInfo_t info = seL4_MessageInfo_new(0, 0, 0, 0);
+    for (int i = 0; i < TPUT_CALLS; i++) {
+        seL4_Call(tput_ep, info);
+    }
+    __atomic_fetch_add(&load_done, 1, __ATOMIC_RELEASE);
+    seL4_Signal(done_ntfn);
+    /* stopped until the next run restarts it */
+    seL4_TCB_Suspend(self);
+}
+
+/* time n load threads, spread over the cores, calling the server workers */
+static void throughput(int n)
+{
+    load_done = 0;
+    ccnt_t start = sel4bench_get_cycle_count();
+    for (int i = 0; i < n; i++) {
+        bench_thread_start(&load_threads[i], i % CONFIG_MAX_NUM_NODES, load_thread,
+                           (void *) load_threads[i].tcb, NULL);
+    }
+    while (__atomic_load_n(&load_done, __ATOMIC_ACQUIRE) < n) {
+        seL4_Wait(done_ntfn, NULL);
+    }
+    ccnt_t cycles = sel4bench_get_cycle_count() - start;
+
+    unsigned long long calls = (unsigned long long) n * TPUT_CALLS;
+    printf("throughput %d clients: %llu calls in %llu cycles, %llu calls/Mcycle\n",
+           n, calls, (unsigned long long) cycles, calls * 1000000 / cycles);
+}
+
+static void run_throughput(void)
+{
+    for (int i = 0; i < IPCBENCH_LOAD_THREADS; i++) {
+        load_threads[i] = (bench_thread_t) {
+            .tcb = load_tcbs + i,
+            .ipc_frame = load_ipc_frames + i,
+            .ipc_buf = (seL4_IPCBuffer *) load_ipc_bufs[i],
+            .stack_top = (uintptr_t) load_stacks[i] + IPCBENCH_STACK_SIZE,
+        };
+        bench_thread_create(&load_threads[i], tcb_untyped, cnode, vspace, tcb, 254);
+    }
+
+    printf("ipcbench: %d server workers on %d cores\n", IPCBENCH_WORKERS, CONFIG_MAX_NUM_NODES);
+    for (int n = 1; n <= IPCBENCH_LOAD_THREADS; n++) {
+        throughput(n);
+    }
+}
+
+#if CONFIG_MAX_NUM_NODES > 1
+static void move_servers(seL4_Word core)
+{
+    seL4_Error error = seL4_TCB_SetAffinity(thread_tcb, core);
+    ZF_LOGF_IFERR(error, "Failed to move local thread");
+    error = seL4_TCB_SetAffinity(server_tcb, core);
+    ZF_LOGF_IFERR(error, "Failed to move server");
+}
+#endif
+
+int main(int c, char *argv[])
+{
+    sel4bench_init();
+
+    for (int i = 0; i < seL4_MsgMaxLength; i++) {
+        seL4_SetMR(i, i);
+    }
+    seL4_SetCapReceivePath(cnode, recv_slot, seL4_WordBits);
+    start_local_server();
+
+    printf("ipcbench: seL4_Call/seL4_ReplyRecv round trips in cycles, %d samples each\n", SAMPLES);
+    bench_stats_print_header();
+    run("same-as same-core", local_ep);
+    run("cross-as same-core", endpoint);
+
+#if CONFIG_MAX_NUM_NODES > 1
+    /* this thread stays on core 0 */
+    move_servers(1);
+    run("same-as cross-core", local_ep);
+    run("cross-as cross-core", endpoint);
+#else
+    printf("ipcbench: single core kernel, skipping cross-core runs\n");
+#endif
+
+    run_throughput();
+
+    sel4bench_destroy();
+    printf("ipcbench: done\n");
+    return 0;
+}
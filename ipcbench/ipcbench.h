@@ -0,0 +1,27 @@
+#pragma once
+
+#include <sel4/sel4.h>
+
+/* threads serving tput_ep in the server, and threads calling it in the client */
+#define IPCBENCH_WORKERS 4
+#define IPCBENCH_LOAD_THREADS 4
+/* stack of each of those threads, as laid out in the capDL spec */
+#define IPCBENCH_STACK_SIZE 16384
+
+/* label of a request that asks for a cap in the reply */
+#define IPCBENCH_LABEL_CAP 1
+
+/*
+ * Build the reply to a benchmark request: the same number of message
+ * registers, which still hold the request, and the cap in transfer_cap if the
+ * request asked for one.
+ */
+static inline seL4_MessageInfo_t ipcbench_reply(seL4_MessageInfo_t info, seL4_CPtr transfer_cap)
+{
+    seL4_Word length = seL4_MessageInfo_get_length(info);
+    if (seL4_MessageInfo_get_label(info) == IPCBENCH_LABEL_CAP) {
+        seL4_SetCap(0, transfer_cap);
+        return seL4_MessageInfo_new(0, 0, 1, length);
+    }
+    return seL4_MessageInfo_new(0, 0, 0, length);
+}
@@ -0,0 +1,55 @@
+#include <stdio.h>
+#include <sel4/sel4.h>
+#include <utils/util.h>
+
+#include <bench/thread.h>
+
+#include "ipcbench.h"
+
+// endpoint the benchmark client calls
+extern seL4_CPtr endpoint;
+// cap sent back to the client when it asks for a cap transfer
+extern seL4_CPtr transfer_ntfn;
+// endpoint served by the throughput workers
+extern seL4_CPtr tput_ep;
+// the CSpace, VSpace and TCB of this process
+extern seL4_CPtr cnode;
+extern seL4_CPtr vspace;
+extern seL4_CPtr tcb;
+// untyped to create the worker TCBs from, and the slots to put them in
+extern seL4_CPtr tcb_untyped;
+extern seL4_CPtr worker_tcbs;
+// IPC buffers of the workers, and the caps to their frames
+extern seL4_CPtr worker_ipc_frames;
+extern char worker_ipc_bufs[IPCBENCH_WORKERS][BIT(seL4_PageBits)];
+extern char worker_stacks[IPCBENCH_WORKERS][IPCBENCH_STACK_SIZE];
+
+static bench_thread_t workers[IPCBENCH_WORKERS];
+
+static void serve(seL4_CPtr ep)
+{
+    seL4_Word badge;
+    seL4_MessageInfo_t info = seL4_Recv(ep, &badge);
+    while (1) {
+        info = seL4_ReplyRecv(ep, ipcbench_reply(info, transfer_ntfn), &badge);
+    }
+}
+
+int main(int c, char *argv[])
+{
+    /* the throughput workers all receive on tput_ep, one per core in turn.
+     * This thread stays on endpoint for the round-trip measurements. */
+    for (int i = 0; i < IPCBENCH_WORKERS; i++) {
+        workers[i] = (bench_thread_t) {
+            .tcb = worker_tcbs + i,
+            .ipc_frame = worker_ipc_frames + i,
+            .ipc_buf = (seL4_IPCBuffer *) worker_ipc_bufs[i],
+            .stack_top = (uintptr_t) worker_stacks[i] + IPCBENCH_STACK_SIZE,
+        };
+        bench_thread_create(&workers[i], tcb_untyped, cnode, vspace, tcb, 254);
+        bench_thread_start(&workers[i], i % CONFIG_MAX_NUM_NODES, serve, (void *) tput_ep, NULL);
+    }
+
+    serve(endpoint);
+    return 0;
+}
@@ -0,0 +1,98 @@
+#include <sel4/sel4.h>
+#include <utils/util.h>
+#include <sel4utils/util.h>
+#include <sel4utils/mapping.h>
+#include <vspace/mapping.h>
+
+#include "channel.h"
+
+static seL4_CPtr alloc_slot(channel_alloc_t *alloc)
+{
+    ZF_LOGF_IF(alloc->next_slot >= alloc->end_slot, "Out of channel slots");
+    return alloc->next_slot++;
+}
+
+/* create the paging structure missing at vaddr in vspace, as reported by the
+ * failed mapping. vspace_get_map_obj knows every level of the arch. */
+static void map_paging_structure(channel_alloc_t *alloc, seL4_CPtr vspace, uintptr_t vaddr)
+{
+    vspace_map_obj_t obj;
+    seL4_Word level = seL4_MappingFailedLookupLevel();
+    int error = vspace_get_map_obj(level, &obj);
+    ZF_LOGF_IF(error, "No paging structure for lookup level %lu", (unsigned long) level);
+
+    seL4_CPtr slot = alloc_slot(alloc);
+    error = seL4_Untyped_Retype(alloc->paging_untyped, obj.type, obj.size_bits, alloc->cnode, 0, 0, slot, 1);
+    ZF_LOGF_IFERR(error, "Failed to retype paging structure");
+    error = vspace_map_obj(&obj, slot, vspace, vaddr, seL4_ARCH_Default_VMAttributes);
+    ZF_LOGF_IFERR(error, "Failed to map paging structure at %p", (void *) vaddr);
+}
+
+void channel_map_frame(channel_alloc_t *alloc, seL4_CPtr frame, seL4_CPtr vspace, uintptr_t vaddr)
+{
+    while (1) {
+        seL4_Error error = seL4_ARCH_Page_Map(frame, vspace, vaddr, seL4_AllRights,
+                                              seL4_ARCH_Default_VMAttributes);
+        if (error != seL4_FailedLookup) {
+            ZF_LOGF_IFERR(error, "Failed to map channel frame at %p", (void *) vaddr);
+            return;
+        }
+        map_paging_structure(alloc, vspace, vaddr);
+    }
+}
+
+/* retype num frames of page_bits into consecutive slots */
+static void retype_frames(channel_alloc_t *alloc, seL4_Word type, seL4_Word page_bits,
+                          size_t num, seL4_CPtr *frames)
+{
+    ZF_LOGF_IF(alloc->end_slot - alloc->next_slot < num, "Out of channel slots");
+    *frames = alloc->next_slot;
+    for (size_t done = 0; done < num;) {
+        seL4_Word batch = MIN(num - done, CONFIG_RETYPE_FAN_OUT_LIMIT);
+        seL4_Error error = seL4_Untyped_Retype(alloc->frame_untyped, type, page_bits, alloc->cnode, 0, 0,
+                                               *frames + done, batch);
+        ZF_LOGF_IFERR(error, "Failed to retype channel frames");
+        done += batch;
+    }
+    alloc->next_slot += num;
+}
+
+void channel_create(channel_t *channel, channel_alloc_t *alloc, size_t size, bool large,
+                    int n, const seL4_CPtr *vspaces, const uintptr_t *vaddrs)
+{
+    ZF_LOGF_IF(!IS_ALIGNED(size, seL4_PageBits), "Channel size must be a multiple of 4K");
+    seL4_Word type = seL4_ARCH_4KPage;
+    channel->page_bits = seL4_PageBits;
+
+#ifdef CONFIG_ARCH_X86_64
+    /* large pages need the size and every address to be aligned to them */
+    for (int i = 0; i < n; i++) {
+        large = large && IS_ALIGNED(vaddrs[i], seL4_LargePageBits);
+    }
+    if (large && IS_ALIGNED(size, seL4_LargePageBits)) {
+        type = seL4_X86_LargePageObject;
+        channel->page_bits = seL4_LargePageBits;
+    }
+#endif
+    channel->num_frames = size >> channel->page_bits;
+    retype_frames(alloc, type, channel->page_bits, channel->num_frames, &channel->frames);
+    channel->size = size;
+
+    for (int i = 0; i < n; i++) {
+        seL4_CPtr frames = channel->frames;
+        if (i > 0) {
+            /* each mapping needs its own copy of the frame cap */
+            ZF_LOGF_IF(alloc->end_slot - alloc->next_slot < channel->num_frames, "Out of channel slots");
+            frames = alloc->next_slot;
+            alloc->next_slot += channel->num_frames;
+            for (size_t f = 0; f < channel->num_frames; f++) {
+                seL4_Error error = seL4_CNode_Copy(alloc->cnode, frames + f, seL4_WordBits,
+                                                   alloc->cnode, channel->frames + f, seL4_WordBits, seL4_AllRights);
+                ZF_LOGF_IFERR(error, "Failed to copy channel frame");
+            }
+        }
+        for (size_t f = 0; f < channel->num_frames; f++) {
+            channel_map_frame(alloc, frames + f, vspaces[i], vaddrs[i] + (f << channel->page_bits));
+        }
+    }
+}
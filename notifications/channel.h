@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sel4/sel4.h>
+
+/*
+ * Shared memory channels created at run time.
+ *
+ * A channel is a run of frames retyped from an untyped and mapped at the
+ * same offsets into one or more vspaces. Large pages (2 MiB on x86_64) are
+ * used where the size and addresses allow it, and 4K frames otherwise. Any
+ * paging structures missing at the addresses are created from a second
+ * untyped, so that the frames are retyped back to back: as long as every
+ * channel of large pages is created before any of 4K frames, none of the
+ * frame untyped is lost to alignment, and it only needs to be as big as the
+ * channels.
+ */
+
+/* where channel objects and caps come from */
+typedef struct {
+    /* untypeds for frames, and for paging structures */
+    seL4_CPtr frame_untyped;
+    seL4_CPtr paging_untyped;
+    /* cnode of the caller, holding the untyped and the slots */
+    seL4_CPtr cnode;
+    /* next free slot, and one past the last */
+    seL4_CPtr next_slot;
+    seL4_CPtr end_slot;
+} channel_alloc_t;
+
+typedef struct {
+    size_t size;
+    /* size of each frame backing the channel */
+    seL4_Word page_bits;
+    size_t num_frames;
+    /* caps to the frames as mapped into the first vspace */
+    seL4_CPtr frames;
+} channel_t;
+
+/*
+ * Create a channel of size bytes, a multiple of the 4K page size, and map it
+ * into vspaces[i] at vaddrs[i] for each of the n vspaces. Large pages are only
+ * tried if large is set.
+ */
+void channel_create(channel_t *channel, channel_alloc_t *alloc, size_t size, bool large,
+                    int n, const seL4_CPtr *vspaces, const uintptr_t *vaddrs);
+
+/* map a single frame into vspace at vaddr, creating any paging structures
+ * missing there */
+void channel_map_frame(channel_alloc_t *alloc, seL4_CPtr frame, seL4_CPtr vspace, uintptr_t vaddr);
@@ -5,89 +5,332 @@
 #include <stdio.h>
 #include <utils/util.h>
 #include <sel4utils/util.h>
+#include <sel4bench/sel4bench.h>
 
-// notification object
-extern seL4_CPtr buf1_empty;
-extern seL4_CPtr buf2_empty;
-extern seL4_CPtr full;
-extern seL4_CPtr endpoint;
+#include "ring.h"
+#include "wait.h"
+#include "channel.h"
+#include "handoff.h"
+
+/* set from the count the capDL spec was generated for, see CMakeLists.txt */
+#ifndef NUM_PRODUCERS
+#error "NUM_PRODUCERS must be defined"
+#endif
 
-extern seL4_CPtr buf1_frame_cap;
-extern const char buf1_frame[4096];
-extern seL4_CPtr buf2_frame_cap;
-extern const char buf2_frame[4096];
+/* producer i signals full with badge bit i */
+compile_time_assert(producers_fit_in_badge, NUM_PRODUCERS <= seL4_BadgeBits);
 
-// cslot containing a capability to the cnode of the server
+// notification objects: one empty per producer, and the shared full
+extern seL4_CPtr empty;
+extern seL4_CPtr full;
+// endpoint of each producer, to start its runs on
+extern seL4_CPtr endpoint;
+// vspaces of each producer
+extern seL4_CPtr producer_vspaces;
 extern seL4_CPtr consumer_vspace;
-extern seL4_CPtr producer_1_vspace;
-extern seL4_CPtr producer_2_vspace;
 
 extern seL4_CPtr cnode;
-extern seL4_CPtr mapping_1;
-extern seL4_CPtr mapping_2;
+// untypeds for channel frames and paging structures, and empty slots to
+// create channels from
+extern seL4_CPtr channel_untyped;
+extern seL4_CPtr channel_paging_untyped;
+extern seL4_CPtr channel_slots;
 
-#define BUF_VADDR 0x5FF000
+// endpoint the producers hand frames over on, and the pool of frames
+extern seL4_CPtr handoff;
+extern seL4_CPtr handoff_frames;
+// empty slot to receive returned frames into
+extern seL4_CPtr handoff_recv;
 
-int main(int c, char *argv[])
+/* frames in the pool, also in gen_spec.py. Each producer holds at most one
+ * at a time, as a returned frame is read before replying. */
+#define HANDOFF_POOL (2 * NUM_PRODUCERS)
+
+/* the ring of producer i is at PRODUCER_VADDR in the producer, and at
+ * CONSUMER_VADDR + i * RING_SIZE here */
+#define PRODUCER_VADDR 0x40000000ul
+#define CONSUMER_VADDR 0x40000000ul
+
+/* channels for the TLB benchmark */
+#define STREAM_SIZE BIT(23)
+#define STREAM_CHANNELS 2
+#define STREAM_LARGE_VADDR 0x80000000ul
+#define STREAM_SMALL_VADDR 0xA0000000ul
+/* passes over each channel, touching each page once in a scattered order */
+#define STREAM_PASSES 8
+#define STREAM_STRIDE_PAGES 61
+
+/* the empty slots gen_spec.py left for every channel with 4K frames, each
+ * with a little slack for paging structures, and the paging structures at
+ * HANDOFF_VADDR. Ring frames are mapped twice. */
+#define CHANNEL_SLACK 8
+#define CHANNEL_NUM_SLOTS (NUM_PRODUCERS * (2 * (RING_SIZE >> seL4_PageBits) + CHANNEL_SLACK) + \
+                           STREAM_CHANNELS * ((STREAM_SIZE >> seL4_PageBits) + CHANNEL_SLACK) + \
+                           CHANNEL_SLACK)
+
+static channel_alloc_t channel_alloc;
+
+static spsc_ring_t *ring_of(int i)
 {
-    seL4_Error error = seL4_NoError;
-    seL4_Word badge;
+    return (spsc_ring_t *)(CONSUMER_VADDR + i * RING_SIZE);
+}
 
-    /* set up shared memory for consumer 1 */
-    /* first duplicate the cap */
-    error = seL4_CNode_Copy(cnode, mapping_1, seL4_WordBits,
-                            cnode, buf1_frame_cap, seL4_WordBits, seL4_AllRights);
-    ZF_LOGF_IFERR(error, "Failed to copy cap");
-    /* now do the mapping */
-    error = seL4_ARCH_Page_Map(mapping_1, producer_1_vspace, BUF_VADDR,
-                               seL4_AllRights, seL4_ARCH_Default_VMAttributes);
-    ZF_LOGF_IFERR(error, "Failed to map frame");
-
-    // TODO share buf2_frame_cap with producer_2
-    error = seL4_CNode_Copy(cnode, mapping_2, seL4_WordBits,
-                            cnode, buf2_frame_cap, seL4_WordBits, seL4_AllRights);
-    ZF_LOGF_IFERR(error, "Failed to copy cap");
-    /* now do the mapping */
-    error = seL4_ARCH_Page_Map(mapping_2, producer_2_vspace, BUF_VADDR,
-                               seL4_AllRights, seL4_ARCH_Default_VMAttributes);
-    ZF_LOGF_IFERR(error, "Failed to map frame");
-    /* send IPCs with the buffer address to both producers */
-    seL4_SetMR(0, BUF_VADDR);
-    seL4_Send(endpoint, seL4_MessageInfo_new(0, 0, 0, 1));
-    seL4_SetMR(0, BUF_VADDR);
-    seL4_Send(endpoint, seL4_MessageInfo_new(0, 0, 0, 1));
-
-    /* start single buffer producer consumer */
-    volatile long *buf1 = (long *)buf1_frame;
-    volatile long *buf2 = (long *)buf2_frame;
-
-    *buf1 = 0;
-    *buf2 = 0;
-
-    // TODO signal both producers
-    seL4_Signal(buf1_empty);
-    seL4_Signal(buf2_empty);
-    printf("Waiting for producer\n");
-    for (int i = 0; i < 10; i++)
-    {
-        seL4_Wait(full, &badge);
-        printf("Got badge: %lx\n", badge);
-
-        // TODO, use the badge to check which producer has signalled you, and signal it back. Note that you
-        // may recieve more than 1 signal at a time.
-        if (badge & 0b01)
-        {
-            assert(*buf1 == 1);
-            *buf1 = 0;
-            seL4_Signal(buf1_empty);
+/* create the channel for the ring of producer i and map it on both sides */
+static void share_ring(int i)
+{
+    channel_t channel;
+    seL4_CPtr vspaces[] = {consumer_vspace, producer_vspaces + i};
+    uintptr_t vaddrs[] = {(uintptr_t) ring_of(i), PRODUCER_VADDR};
+    channel_create(&channel, &channel_alloc, RING_SIZE, true, ARRAY_SIZE(vspaces), vspaces, vaddrs);
+}
+
+/* time creating a channel of large pages, or of 4K frames, and reading one
+ * word from each page of it over and over, mostly missing the TLB */
+static void stream(bool large)
+{
+    uintptr_t vaddr = large ? STREAM_LARGE_VADDR : STREAM_SMALL_VADDR;
+    channel_t channel;
+    ccnt_t start = sel4bench_get_cycle_count();
+    channel_create(&channel, &channel_alloc, STREAM_SIZE, large, 1, &consumer_vspace, &vaddr);
+    ccnt_t setup = sel4bench_get_cycle_count() - start;
+
+    size_t pages = STREAM_SIZE >> seL4_PageBits;
+    seL4_Word sum = 0;
+    start = sel4bench_get_cycle_count();
+    for (int pass = 0; pass < STREAM_PASSES; pass++) {
+        for (size_t i = 0; i < pages; i++) {
+            size_t page = (i * STREAM_STRIDE_PAGES) % pages;
+            sum += *(volatile seL4_Word *)(vaddr + (page << seL4_PageBits));
+        }
+    }
+    ccnt_t cycles = sel4bench_get_cycle_count() - start;
+
+    printf("stream over %zu %s frames: setup %llu cycles, %llu cycles/access (sum %lu)\n",
+           channel.num_frames, channel.page_bits == seL4_PageBits ? "4K" : "large",
+           (unsigned long long) setup, (unsigned long long)(cycles / (STREAM_PASSES * pages)),
+           (unsigned long) sum);
+}
+
+/* next item expected from each producer */
+static long expected[NUM_PRODUCERS];
+
+/* take every item currently in the ring of producer i, checking they arrive
+ * in order */
+static int drain(int i)
+{
+    spsc_ring_t *ring = ring_of(i);
+    int n = 0;
+    long item;
+    while (ring_consume(ring, &item, empty + i)) {
+        ZF_LOGF_IF(item != expected[i], "Producer %d: expected item %ld, got %ld", i + 1, expected[i], item);
+        expected[i]++;
+        n++;
+    }
+    return n;
+}
+
+/* wait_ops_t over the rings whose bits are set in the cookie */
+static seL4_Word rings_poll(void *cookie)
+{
+    seL4_Word ready = 0;
+    for (seL4_Word bits = *(seL4_Word *) cookie; bits != 0; bits &= bits - 1) {
+        int i = CTZL(bits);
+        if (!ring_empty(ring_of(i))) {
+            ready |= BIT(i);
         }
-        if (badge & 0b10)
-        {
-            assert(*buf2 == 2);
-            *buf2 = 0;
-            seL4_Signal(buf2_empty);
+    }
+    return ready;
+}
+
+static seL4_Word rings_arm(void *cookie)
+{
+    seL4_Word busy = 0;
+    for (seL4_Word bits = *(seL4_Word *) cookie; bits != 0; bits &= bits - 1) {
+        int i = CTZL(bits);
+        spsc_ring_t *ring = ring_of(i);
+        if (!ring_prepare_wait(&ring->consumer_waiting, ring, false)) {
+            busy |= BIT(i);
         }
     }
+    return busy;
+}
+
+static ccnt_t rings_signalled_at(void *cookie, seL4_Word badge)
+{
+    ccnt_t first = ~(ccnt_t) 0;
+    for (seL4_Word bits = badge; bits != 0; bits &= bits - 1) {
+        spsc_ring_t *ring = ring_of(CTZL(bits));
+        first = MIN(first, (ccnt_t) ring_load(&ring->signalled_at));
+    }
+    return first;
+}
+
+static const wait_ops_t rings_wait_ops = {
+    .poll = rings_poll,
+    .arm = rings_arm,
+    .signalled_at = rings_signalled_at,
+};
+
+/* start n producers and consume the RING_ITEMS each of them sends */
+static void run(int n)
+{
+    ccnt_t start = sel4bench_get_cycle_count();
+
+    /* each producer has its own endpoint, so exactly the first n run */
+    for (int i = 0; i < n; i++) {
+        seL4_SetMR(0, PRODUCER_VADDR);
+        seL4_Send(endpoint + i, seL4_MessageInfo_new(0, 0, 0, 1));
+    }
+    long first[NUM_PRODUCERS];
+    for (int i = 0; i < n; i++) {
+        first[i] = expected[i];
+    }
+
+    /* rings to drain, one bit per producer as in the badge of full. Every
+     * ring outside this set has its waiting flag up, so its producer will
+     * signal before we miss an item. */
+    seL4_Word pending = MASK(NUM_PRODUCERS);
+    long consumed = 0;
+    wait_state_t waiter;
+    wait_init(&waiter);
+    while (consumed < n * RING_ITEMS) {
+        int got = 0;
+        for (seL4_Word bits = pending; bits != 0; bits &= bits - 1) {
+            got += drain(CTZL(bits));
+        }
+        consumed += got;
+        if (got == 0) {
+            bool armed;
+            seL4_Word work = wait_adaptive(&waiter, full, &rings_wait_ops, &pending, &armed);
+            /* once armed, only the rings with work need draining */
+            pending = armed ? work : pending | work;
+        }
+    }
+
+    ccnt_t cycles = sel4bench_get_cycle_count() - start;
+    for (int i = 0; i < n; i++) {
+        ZF_LOGF_IF(expected[i] - first[i] != RING_ITEMS, "Producer %d sent %ld items, not %ld", i + 1,
+                   expected[i] - first[i], RING_ITEMS);
+    }
+    printf("%2d producers: %ld items in %llu cycles, %llu items/Mcycle\n", n, consumed,
+           (unsigned long long) cycles, (unsigned long long) consumed * 1000000 / cycles);
+    wait_print(&waiter, "    wait");
+}
+
+/* indices of the frames in the pool no producer holds */
+static seL4_Word free_frames[HANDOFF_POOL];
+static int num_free;
+
+/* build the reply handing the next free frame to a producer */
+static seL4_MessageInfo_t handoff_give(void)
+{
+    ZF_LOGF_IF(num_free == 0, "Frame pool is empty");
+    seL4_Word index = free_frames[--num_free];
+    seL4_SetCap(0, handoff_frames + index);
+    seL4_SetMR(0, index);
+    return seL4_MessageInfo_new(0, 0, 1, 1);
+}
+
+/* read the items in the frame producer i returned where they are, then drop
+ * our copy of its cap so the frame is back in the pool */
+static int handoff_take(int i, seL4_MessageInfo_t info)
+{
+    seL4_Word index = seL4_GetMR(0);
+    ZF_LOGF_IF(seL4_MessageInfo_get_extraCaps(info) != 1 || index >= HANDOFF_POOL,
+               "Producer %d returned no frame", i + 1);
+
+    channel_map_frame(&channel_alloc, handoff_recv, consumer_vspace, HANDOFF_VADDR);
+    handoff_frame_t *payload = (handoff_frame_t *) HANDOFF_VADDR;
+    size_t count = payload->count;
+    ZF_LOGF_IF(count > HANDOFF_ITEMS, "Producer %d: %zu items do not fit a frame", i + 1, count);
+    for (size_t j = 0; j < count; j++) {
+        ZF_LOGF_IF(payload->items[j] != expected[i], "Producer %d: expected item %ld, got %ld", i + 1,
+                   expected[i], payload->items[j]);
+        expected[i]++;
+    }
+
+    seL4_Error error = seL4_ARCH_Page_Unmap(handoff_recv);
+    ZF_LOGF_IFERR(error, "Failed to unmap frame");
+    error = seL4_CNode_Delete(cnode, handoff_recv, seL4_WordBits);
+    ZF_LOGF_IFERR(error, "Failed to delete frame cap");
+    free_frames[num_free++] = index;
+    return count;
+}
+
+/* start n producers on a handoff run and take the HANDOFF_FRAMES frames each
+ * of them fills */
+static void handoff_serve(int n)
+{
+    ccnt_t start = sel4bench_get_cycle_count();
+
+    for (int i = 0; i < n; i++) {
+        seL4_Send(endpoint + i, seL4_MessageInfo_new(HANDOFF_START, 0, 0, 0));
+    }
+
+    seL4_SetCapReceivePath(cnode, handoff_recv, seL4_WordBits);
+    long consumed = 0;
+    int done = 0;
+    seL4_Word badge;
+    seL4_MessageInfo_t info = seL4_Recv(handoff, &badge);
+    while (1) {
+        seL4_Word label = seL4_MessageInfo_get_label(info);
+        ZF_LOGF_IF(badge == 0 || badge > NUM_PRODUCERS, "Unexpected badge %lu", (unsigned long) badge);
+        if (label == HANDOFF_PUT || label == HANDOFF_DONE) {
+            consumed += handoff_take(badge - 1, info);
+        } else {
+            ZF_LOGF_IF(label != HANDOFF_GET, "Unexpected label %lu", (unsigned long) label);
+        }
+
+        if (label != HANDOFF_DONE) {
+            info = seL4_ReplyRecv(handoff, handoff_give(), &badge);
+        } else if (++done < n) {
+            info = seL4_ReplyRecv(handoff, seL4_MessageInfo_new(0, 0, 0, 0), &badge);
+        } else {
+            seL4_Reply(seL4_MessageInfo_new(0, 0, 0, 0));
+            break;
+        }
+    }
+
+    ccnt_t cycles = sel4bench_get_cycle_count() - start;
+    printf("%2d producers: handoff of %ld items in %llu cycles, %llu items/Mcycle\n", n, consumed,
+           (unsigned long long) cycles, (unsigned long long) consumed * 1000000 / cycles);
+}
+
+int main(int c, char *argv[])
+{
+    channel_alloc = (channel_alloc_t) {
+        .frame_untyped = channel_untyped,
+        .paging_untyped = channel_paging_untyped,
+        .cnode = cnode,
+        .next_slot = channel_slots,
+        .end_slot = channel_slots + CHANNEL_NUM_SLOTS,
+    };
+    sel4bench_init();
+
+    /* set up shared memory with every producer. The rings and the large
+     * stream channel come before the 4K one, see channel.h. */
+    for (int i = 0; i < NUM_PRODUCERS; i++) {
+        share_ring(i);
+        ring_init(ring_of(i));
+    }
+
+    stream(true);
+    stream(false);
+
+    printf("Waiting for producer\n");
+    /* aggregate throughput as the number of producers grows */
+    for (int n = 1; n <= NUM_PRODUCERS; n++) {
+        run(n);
+    }
+
+    /* and again passing whole frames instead of through the rings */
+    for (int i = 0; i < HANDOFF_POOL; i++) {
+        free_frames[num_free++] = i;
+    }
+    for (int n = 1; n <= NUM_PRODUCERS; n++) {
+        handoff_serve(n);
+    }
+    sel4bench_destroy();
     printf("Success!\n");
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,212 @@
+#!/usr/bin/env python3
+#
+# Copyright 2018, Data61
+# Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+# ABN 41 687 119 230.
+#
+# This software may be distributed and modified according to the terms of
+# the BSD 2-Clause license. Note that NO WARRANTY is provided.
+# See "LICENSE_BSD2.txt" for details.
+#
+# @TAG(DATA61_BSD)
+#
+
+"""
+Generate the capDL manifest and allocator state for the notifications example
+with a consumer and a given number of producers.
+
+Producer i (from 1) gets:
+  1 empty            notification the consumer signals when its ring has room
+  2 full             notification shared by all producers, badged with bit i - 1
+  3 endpoint         its own, the consumer sends the ring address on
+  4 handoff          endpoint to pass frames to the consumer on, badged with i
+  5 vspace, cnode    its own, to map the frames it is passed
+  7 handoff_untyped  for paging structures, and HANDOFF_SLOTS empty slots
+
+The consumer gets, in order: the N empty notifications, full, the N endpoints, the N
+producer vspaces, its cnode, its own vspace, an untyped for channel frames,
+one for their paging structures and enough empty slots to create the channels the rings live in (see channel.h) and those of
+its TLB benchmark, even if they all fall back to 4K frames. Then handoff, a
+pool of 2N frames to pass to the producers and a slot to receive them back
+in (see handoff.h).
+
+On a multicore kernel the consumer runs on core 0 and the producers are spread
+over the other cores, so that the consumer's spin phase (see wait.h) can see
+them make progress. On a single core everything runs on core 0.
+"""
+
+import argparse
+import math
+import pickle
+
+from capdl import ObjectType, Cap, lookup_architecture
+from capdl.Allocator import ObjectAllocator, CSpaceAllocator, AddressSpaceAllocator, AllocatorState
+
+# must match ring.h and consumer.c
+PAGE_SIZE = 4096
+RING_SIZE = 4 << 20
+STREAM_SIZE = 8 << 20
+STREAM_CHANNELS = 2
+# paging structures and copies of frame caps for any one channel
+CHANNEL_SLACK = 8
+# must match handoff.h and consumer.c
+HANDOFF_SLOTS = 6
+HANDOFF_POOL_PER_PRODUCER = 2
+
+STACK_PAGES = 16
+
+
+def add_component(obj_space, arch, cspaces, pds, addr_spaces, elf, core):
+    """create the cnode, vspace, stack, ipc buffer and tcb of one process, to
+    run on core"""
+    cnode = obj_space.alloc(ObjectType.seL4_CapTableObject, name='cnode_%s' % elf, size_bits='auto')
+    vspace = obj_space.alloc(arch.vspace().object, name='vspace_%s' % elf)
+    ipc = obj_space.alloc(ObjectType.seL4_FrameObject, name='ipc_%s_obj' % elf, label=elf, size=PAGE_SIZE)
+    stack = [obj_space.alloc(ObjectType.seL4_FrameObject, name='stack_%d_%s_obj' % (i, elf), label=elf,
+                             size=PAGE_SIZE) for i in range(STACK_PAGES)]
+
+    cspace_cap = Cap(cnode)
+    cnode.update_guard_size_caps.append(cspace_cap)
+    tcb = obj_space.alloc(ObjectType.seL4_TCBObject, name='tcb_%s' % elf)
+    tcb['ipc_buffer_slot'] = Cap(ipc, read=True, write=True)
+    tcb['cspace'] = cspace_cap
+    tcb['vspace'] = Cap(vspace)
+    tcb.addr = "get_vaddr('mainIpcBuffer')"
+    tcb.ip = "get_vaddr('_start')"
+    tcb.sp = "get_vaddr('stack') + %d" % PAGE_SIZE
+    tcb.init = '[0,0,0,0,2,get_vaddr("progname"),1,0,0,32,get_vaddr("sel4_vsyscall"),0,0]'
+    tcb.affinity = core
+
+    cspaces[elf] = CSpaceAllocator(cnode)
+    pds[elf] = vspace
+    addr_spaces[elf] = AddressSpaceAllocator(None, vspace)
+    addr_spaces[elf].add_symbol_with_caps('stack', [PAGE_SIZE] * STACK_PAGES,
+                                          [Cap(f, read=True, write=True) for f in stack])
+    addr_spaces[elf].add_symbol_with_caps('mainIpcBuffer', [PAGE_SIZE], [Cap(ipc, read=True, write=True)])
+    return tcb
+
+
+def place(cspace, symbols):
+    """put (name, cap or list of caps) pairs in consecutive slots. None leaves
+    a slot empty. Returns the (name, first slot) pairs for the manifest."""
+    manifest = []
+    for name, caps in symbols:
+        manifest.append((name, cspace.slot))
+        for cap in caps if isinstance(caps, list) else [caps]:
+            cspace.cnode[cspace.slot] = cap
+            cspace.slot += 1
+    return manifest
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().split('\n')[0])
+    parser.add_argument('--producers', type=int, required=True)
+    parser.add_argument('--arch', required=True, help='KernelSel4Arch of the build')
+    parser.add_argument('--cores', type=int, required=True, help='KernelMaxNumNodes of the build')
+    parser.add_argument('--manifest', required=True)
+    parser.add_argument('--allocator', required=True)
+    args = parser.parse_args()
+    n = args.producers
+
+    arch = lookup_architecture(args.arch)
+    obj_space = ObjectAllocator()
+    obj_space.spec.arch = args.arch
+    cspaces, pds, addr_spaces = {}, {}, {}
+
+    producers = ['producer_%d' % i for i in range(1, n + 1)]
+    # must match WAIT_SPIN in wait.h: producers only leave the consumer's
+    # core when there is another one
+    cores = {elf: 1 + i % (args.cores - 1) if args.cores > 1 else 0 for i, elf in enumerate(producers)}
+    cores['consumer'] = 0
+    tcbs = {elf: add_component(obj_space, arch, cspaces, pds, addr_spaces, elf, cores[elf])
+            for elf in producers + ['consumer']}
+
+    full = obj_space.alloc(ObjectType.seL4_NotificationObject, name='full')
+    endpoints = [obj_space.alloc(ObjectType.seL4_EndpointObject, name='endpoint_%d' % i)
+                 for i in range(1, n + 1)]
+    empty = [obj_space.alloc(ObjectType.seL4_NotificationObject, name='buf%d_empty' % i)
+             for i in range(1, n + 1)]
+
+    # memory for the frames of every channel. The consumer retypes them back
+    # to back, large pages first, so none is lost to alignment.
+    memory = n * RING_SIZE + STREAM_CHANNELS * STREAM_SIZE
+    untyped = obj_space.alloc(ObjectType.seL4_UntypedObject, name='channel_untyped',
+                              size_bits=int(math.ceil(math.log2(memory))))
+    # paging structures come from their own untyped, at most one per slot of
+    # slack and none bigger than a page
+    paging_memory = (n + STREAM_CHANNELS + 1) * CHANNEL_SLACK * PAGE_SIZE
+    paging_untyped = obj_space.alloc(ObjectType.seL4_UntypedObject, name='channel_paging_untyped',
+                                     size_bits=int(math.ceil(math.log2(paging_memory))))
+    # Ring frames are mapped twice, so need a second slot each; benchmark
+    # frames only once. Then the paging structures where handed off frames
+    # are mapped.
+    slots = (n * (2 * RING_SIZE // PAGE_SIZE + CHANNEL_SLACK) +
+             STREAM_CHANNELS * (STREAM_SIZE // PAGE_SIZE + CHANNEL_SLACK) + CHANNEL_SLACK)
+
+    handoff = obj_space.alloc(ObjectType.seL4_EndpointObject, name='handoff')
+    pool = [obj_space.alloc(ObjectType.seL4_FrameObject, name='handoff_frame_%d' % i, size=PAGE_SIZE)
+            for i in range(HANDOFF_POOL_PER_PRODUCER * n)]
+
+    def rw(obj, **kwargs):
+        return Cap(obj, read=True, write=True, grant=True, **kwargs)
+
+    cap_symbols = {}
+    for i, elf in enumerate(producers):
+        cnode_cap = Cap(cspaces[elf].cnode)
+        cspaces[elf].cnode.update_guard_size_caps.append(cnode_cap)
+        # enough for a page table and the levels above it
+        paging = obj_space.alloc(ObjectType.seL4_UntypedObject, name='handoff_untyped_%s' % elf,
+                                 size_bits=16)
+        cap_symbols[elf] = place(cspaces[elf], [
+            ('empty', rw(empty[i])),
+            ('full', rw(full, badge=1 << i)),
+            ('endpoint', rw(endpoints[i])),
+            ('handoff', rw(handoff, badge=i + 1)),
+            ('vspace', Cap(pds[elf])),
+            ('cnode', cnode_cap),
+            ('handoff_untyped', Cap(paging)),
+            ('handoff_slots', [None] * HANDOFF_SLOTS),
+        ])
+
+    consumer = cspaces['consumer']
+    cnode_cap = Cap(consumer.cnode)
+    consumer.cnode.update_guard_size_caps.append(cnode_cap)
+    cap_symbols['consumer'] = place(consumer, [
+        ('empty', [rw(e) for e in empty]),
+        ('full', rw(full)),
+        ('endpoint', [rw(e) for e in endpoints]),
+        ('producer_vspaces', [Cap(pds[elf]) for elf in producers]),
+        ('cnode', cnode_cap),
+        ('consumer_vspace', Cap(pds['consumer'])),
+        ('channel_untyped', Cap(untyped)),
+        ('channel_paging_untyped', Cap(paging_untyped)),
+        ('channel_slots', [None] * slots),
+        ('handoff', rw(handoff)),
+        ('handoff_frames', [rw(f) for f in pool]),
+        ('handoff_recv', None),
+    ])
+
+    # each process can also see its own tcb, after its symbols
+    for elf, tcb in tcbs.items():
+        cspaces[elf].cnode[cspaces[elf].slot] = Cap(tcb)
+        cspaces[elf].slot += 1
+
+    with open(args.allocator, 'wb') as f:
+        pickle.dump(AllocatorState(obj_space, cspaces, pds, addr_spaces), f)
+
+    regions = {elf: [] for elf in producers + ['consumer']}
+    with open(args.manifest, 'w') as f:
+        f.write('cap_symbols:\n')
+        for elf, symbols in cap_symbols.items():
+            f.write('  %s:\n' % elf)
+            for name, slot in symbols:
+                f.write('    - - %s\n      - %d\n' % (name, slot))
+        f.write('region_symbols:\n')
+        for elf, symbols in regions.items():
+            f.write('  %s:\n' % elf)
+            for name, size in symbols + [('stack', STACK_PAGES * PAGE_SIZE), ('mainIpcBuffer', PAGE_SIZE)]:
+                f.write('    - - %s\n      - %d\n      - size_12bit\n' % (name, size))
+
+
+if __name__ == '__main__':
+    main()
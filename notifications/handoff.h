@@ -0,0 +1,53 @@
+#pragma once
+
+#include <sel4/sel4.h>
+#include <utils/util.h>
+
+/*
+ * Zero-copy handoff of whole frames from the producers to the consumer.
+ *
+ * The consumer owns a pool of frames. A producer asks for one over the
+ * handoff endpoint and gets the frame cap back in the reply, maps it and
+ * fills it. It then unmaps the frame and returns the cap in its next call,
+ * deleting its own copy once the call returns. The consumer maps the
+ * returned cap, reads the items in place and deletes its copy of the cap,
+ * which puts the frame back in the pool. The reply carries the producer's
+ * next frame.
+ *
+ * The items are never copied. Only one side has the frame mapped at a time,
+ * and the consumer keeps the original caps so it could revoke a frame from a
+ * producer that does not return it.
+ *
+ * Producers call with one of the labels below and the badge of their
+ * handoff cap, PRODUCER_ID. Frames travel as one extra cap, with MR 0
+ * holding the index of the frame in the pool.
+ */
+
+/* label of the message on endpoint that starts a handoff run */
+#define HANDOFF_START 1
+
+enum handoff_label {
+    /* ask for the first frame */
+    HANDOFF_GET = 1,
+    /* return a full frame and ask for another */
+    HANDOFF_PUT,
+    /* return the last full frame of the run */
+    HANDOFF_DONE,
+};
+
+/* frames a producer fills each run */
+#define HANDOFF_FRAMES 32
+
+/* empty slots each producer has for the two frames it holds during a call
+ * and for paging structures, also in gen_spec.py */
+#define HANDOFF_SLOTS 6
+
+/* where each side maps the frame it holds */
+#define HANDOFF_VADDR 0x30000000ul
+
+typedef struct {
+    seL4_Word count;
+    long items[];
+} handoff_frame_t;
+
+#define HANDOFF_ITEMS ((BIT(seL4_PageBits) - sizeof(handoff_frame_t)) / sizeof(long))
@@ -0,0 +1,100 @@
+
+#include <assert.h>
+#include <stdio.h>
+#include <sel4/sel4.h>
+#include <utils/util.h>
+#include <sel4utils/util.h>
+
+#include "ring.h"
+#include "channel.h"
+#include "handoff.h"
+
+/* built once per producer, see CMakeLists.txt */
+#ifndef PRODUCER_ID
+#error "PRODUCER_ID must be defined"
+#endif
+
+// caps to notification objects
+extern seL4_CPtr empty;
+extern seL4_CPtr full;
+// endpoint the consumer starts runs of this producer on
+extern seL4_CPtr endpoint;
+// endpoint to pass frames to the consumer on, badged with PRODUCER_ID
+extern seL4_CPtr handoff;
+
+extern seL4_CPtr vspace;
+extern seL4_CPtr cnode;
+// untyped for paging structures, and HANDOFF_SLOTS empty slots
+extern seL4_CPtr handoff_untyped;
+extern seL4_CPtr handoff_slots;
+
+static channel_alloc_t handoff_alloc;
+
+/* fill HANDOFF_FRAMES frames from the consumer with the next items and hand
+ * each back, see handoff.h */
+static void handoff_run(long *next)
+{
+    seL4_CPtr frame = handoff_slots;
+    seL4_CPtr spare = handoff_slots + 1;
+
+    seL4_SetCapReceivePath(cnode, frame, seL4_WordBits);
+    seL4_MessageInfo_t info = seL4_Call(handoff, seL4_MessageInfo_new(HANDOFF_GET, 0, 0, 0));
+    ZF_LOGF_IF(seL4_MessageInfo_get_extraCaps(info) != 1, "No frame from the consumer");
+
+    for (int f = 0; f < HANDOFF_FRAMES; f++) {
+        seL4_Word index = seL4_GetMR(0);
+        channel_map_frame(&handoff_alloc, frame, vspace, HANDOFF_VADDR);
+        handoff_frame_t *payload = (handoff_frame_t *) HANDOFF_VADDR;
+        for (size_t i = 0; i < HANDOFF_ITEMS; i++) {
+            payload->items[i] = (*next)++;
+        }
+        payload->count = HANDOFF_ITEMS;
+        seL4_Error error = seL4_ARCH_Page_Unmap(frame);
+        ZF_LOGF_IFERR(error, "Failed to unmap frame");
+
+        /* return the frame, and take the next one into the spare slot */
+        bool last = f == HANDOFF_FRAMES - 1;
+        seL4_SetCapReceivePath(cnode, spare, seL4_WordBits);
+        seL4_SetCap(0, frame);
+        seL4_SetMR(0, index);
+        info = seL4_Call(handoff, seL4_MessageInfo_new(last ? HANDOFF_DONE : HANDOFF_PUT, 0, 1, 1));
+        ZF_LOGF_IF(!last && seL4_MessageInfo_get_extraCaps(info) != 1, "No frame from the consumer");
+
+        /* the consumer has its own copy now */
+        error = seL4_CNode_Delete(cnode, frame, seL4_WordBits);
+        ZF_LOGF_IFERR(error, "Failed to delete frame cap");
+        seL4_CPtr next_frame = spare;
+        spare = frame;
+        frame = next_frame;
+    }
+}
+
+int main(int c, char *argv[]) {
+    long next = 0;
+    /* for the wake-up timestamps in the ring */
+    sel4bench_init();
+
+    /* the first two slots hold frames, the rest are for paging structures */
+    handoff_alloc = (channel_alloc_t) {
+        .paging_untyped = handoff_untyped,
+        .cnode = cnode,
+        .next_slot = handoff_slots + 2,
+        .end_slot = handoff_slots + HANDOFF_SLOTS,
+    };
+
+    /* each message from the consumer starts a run of RING_ITEMS items, or of
+     * HANDOFF_FRAMES frames. The numbering carries on between runs so the
+     * consumer can check order. */
+    while (1) {
+        seL4_MessageInfo_t info = seL4_Recv(endpoint, NULL);
+        if (seL4_MessageInfo_get_label(info) == HANDOFF_START) {
+            handoff_run(&next);
+            continue;
+        }
+        spsc_ring_t *ring = (spsc_ring_t *) seL4_GetMR(0);
+        for (long i = 0; i < RING_ITEMS; i++) {
+            ring_produce(ring, next++, full, empty);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sel4/sel4.h>
+#include <utils/util.h>
+#include <sel4bench/sel4bench.h>
+
+/*
+ * Single-producer, single-consumer ring of longs laid over memory shared
+ * between two processes.
+ *
+ * Neither side makes a syscall while the other keeps up. A side that finds
+ * the ring empty (consumer) or full (producer) sets its waiting flag, checks
+ * the ring again and only then blocks on its notification. The other side
+ * swaps the flag back to zero when it next makes progress and signals only
+ * if it was set, so there is at most one signal per sleep. Both sides order
+ * "store my index, load the other's flag" against "store my flag, load the
+ * other's index" with a full fence, so one of them always sees the other.
+ */
+
+/* each ring fills a channel of this size, see channel.h */
+#define RING_SIZE BIT(22)
+
+/* keep each index on its own cache line so the two sides do not share one */
+typedef struct {
+    seL4_Word value;
+} ALIGN(64) ring_index_t;
+
+typedef struct {
+    /* written by the consumer */
+    ring_index_t head;
+    ring_index_t consumer_waiting;
+    /* written by the producer */
+    ring_index_t tail;
+    ring_index_t producer_waiting;
+    /* cycle count when the producer last signalled the consumer */
+    ring_index_t signalled_at;
+    long items[];
+} spsc_ring_t;
+
+#define RING_CAPACITY ((RING_SIZE - offsetof(spsc_ring_t, items)) / sizeof(long))
+
+/* items a producer sends through its ring each run. Several rings' worth, so
+ * the indices wrap and a producer that gets ahead finds the ring full. */
+#define RING_ITEMS ((long) (RING_CAPACITY * 7 / 2))
+
+static inline void ring_init(spsc_ring_t *ring)
+{
+    ring->head.value = 0;
+    ring->tail.value = 0;
+    ring->consumer_waiting.value = 0;
+    ring->producer_waiting.value = 0;
+    ring->signalled_at.value = 0;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+static inline seL4_Word ring_load(ring_index_t *index)
+{
+    return __atomic_load_n(&index->value, __ATOMIC_ACQUIRE);
+}
+
+static inline void ring_store(ring_index_t *index, seL4_Word value)
+{
+    __atomic_store_n(&index->value, value, __ATOMIC_RELEASE);
+}
+
+static inline bool ring_empty(spsc_ring_t *ring)
+{
+    return ring_load(&ring->head) == ring_load(&ring->tail);
+}
+
+/* signal ntfn if the other side set its waiting flag, recording the time in
+ * stamp if there is one */
+static inline void ring_wake(ring_index_t *waiting, seL4_CPtr ntfn, ring_index_t *stamp)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&waiting->value, __ATOMIC_RELAXED) &&
+        __atomic_exchange_n(&waiting->value, 0, __ATOMIC_ACQ_REL)) {
+        if (stamp != NULL) {
+            ring_store(stamp, sel4bench_get_cycle_count());
+        }
+        seL4_Signal(ntfn);
+    }
+}
+
+/* set a waiting flag, then check whether the ring still blocks this side.
+ * Returns true if it does and the caller should wait on its notification. */
+static inline bool ring_prepare_wait(ring_index_t *waiting, spsc_ring_t *ring, bool producer)
+{
+    ring_store(waiting, 1);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    seL4_Word used = ring_load(&ring->tail) - ring_load(&ring->head);
+    if (producer ? used < RING_CAPACITY : used > 0) {
+        __atomic_exchange_n(&waiting->value, 0, __ATOMIC_ACQ_REL);
+        return false;
+    }
+    return true;
+}
+
+/* producer: append item, blocking on empty while the ring is full. Wakes the
+ * consumer through full if it is waiting for an item. */
+static inline void ring_produce(spsc_ring_t *ring, long item, seL4_CPtr full, seL4_CPtr empty)
+{
+    seL4_Word tail = ring->tail.value;
+    while (tail - ring_load(&ring->head) == RING_CAPACITY) {
+        if (ring_prepare_wait(&ring->producer_waiting, ring, true)) {
+            seL4_Wait(empty, NULL);
+        }
+    }
+    ring->items[tail % RING_CAPACITY] = item;
+    ring_store(&ring->tail, tail + 1);
+    ring_wake(&ring->consumer_waiting, full, &ring->signalled_at);
+}
+
+/* consumer: take the next item without blocking. Returns false if the ring
+ * is empty. Wakes the producer through empty if it is waiting for room. */
+static inline bool ring_consume(spsc_ring_t *ring, long *item, seL4_CPtr empty)
+{
+    seL4_Word head = ring->head.value;
+    if (head == ring_load(&ring->tail)) {
+        return false;
+    }
+    *item = ring->items[head % RING_CAPACITY];
+    ring_store(&ring->head, head + 1);
+    ring_wake(&ring->producer_waiting, empty, NULL);
+    return true;
+}
@@ -0,0 +1,82 @@
+#include <autoconf.h>
+#include <stdio.h>
+#include <sel4/sel4.h>
+#include <utils/util.h>
+#include <sel4bench/sel4bench.h>
+
+#include "wait.h"
+
+void wait_init(wait_state_t *state)
+{
+    *state = (wait_state_t) {
+        .budget = WAIT_SPIN_INITIAL,
+    };
+}
+
+#if WAIT_SPIN
+static seL4_Word spin(wait_state_t *state, seL4_CPtr ntfn, const wait_ops_t *ops, void *cookie)
+{
+    ccnt_t start = sel4bench_get_cycle_count();
+    for (uint64_t round = 1; sel4bench_get_cycle_count() - start < state->budget; round++) {
+        seL4_Word work = ops->poll(cookie);
+        if (work == 0 && round % WAIT_POLL_INTERVAL == 0) {
+            /* picks up signals from sources that were still armed */
+            seL4_Poll(ntfn, &work);
+        }
+        if (work != 0) {
+            state->spins++;
+            state->spin_rounds += round;
+            return work;
+        }
+    }
+    return 0;
+}
+#endif
+
+seL4_Word wait_adaptive(wait_state_t *state, seL4_CPtr ntfn, const wait_ops_t *ops, void *cookie,
+                        bool *armed)
+{
+    *armed = false;
+    seL4_Word work;
+#if WAIT_SPIN
+    work = spin(state, ntfn, ops, cookie);
+    if (work != 0) {
+        return work;
+    }
+#endif
+
+    *armed = true;
+    work = ops->arm(cookie);
+    if (work != 0) {
+        return work;
+    }
+
+    ccnt_t blocked_at = sel4bench_get_cycle_count();
+    seL4_Wait(ntfn, &work);
+    ccnt_t woken_at = sel4bench_get_cycle_count();
+    state->blocks++;
+
+    /* the signal predates blocking if it was left over from an earlier wait,
+     * and cannot come after waking however far apart the cores' counters are */
+    ccnt_t signalled_at = MIN(MAX(ops->signalled_at(cookie, work), blocked_at), woken_at);
+    ccnt_t latency = woken_at - signalled_at;
+    state->wake_latency_total += latency;
+    state->wake_latency_max = MAX(state->wake_latency_max, latency);
+
+    /* would spinning for one more budget have caught the signal */
+    if (signalled_at - blocked_at <= state->budget) {
+        state->budget = MIN(state->budget * 2, WAIT_SPIN_MAX);
+    } else {
+        state->budget = MAX(state->budget / 2, WAIT_SPIN_MIN);
+    }
+    return work;
+}
+
+void wait_print(wait_state_t *state, const char *name)
+{
+    printf("%s: %llu spins (%llu rounds), %llu blocks, wake latency %llu avg %llu max, budget %llu\n",
+           name, (unsigned long long) state->spins, (unsigned long long) state->spin_rounds,
+           (unsigned long long) state->blocks,
+           (unsigned long long)(state->blocks ? state->wake_latency_total / state->blocks : 0),
+           (unsigned long long) state->wake_latency_max, (unsigned long long) state->budget);
+}
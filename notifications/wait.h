@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <autoconf.h>
+#include <sel4/sel4.h>
+#include <sel4bench/sel4bench.h>
+
+/*
+ * Adaptive spin-then-block wait on a notification.
+ *
+ * Blocking in seL4_Wait costs a kernel entry on each side plus a context
+ * switch, which dominates when the next item is only a little way off. The
+ * waiter first spins, checking the shared state it waits on and polling the
+ * notification, for up to a budget of cycles. Only then does it arm its
+ * sources and block.
+ *
+ * The budget tunes itself on each block. If the signal came within one
+ * budget of blocking, spinning twice as long would have caught it, so the
+ * budget doubles. Otherwise it halves.
+ *
+ * Spinning only pays if the sources run on other cores. gen_spec.py puts
+ * the consumer on core 0 and the producers on the others whenever there are
+ * any, and WAIT_SPIN is set exactly then. Otherwise nothing else can run
+ * while the waiter spins, so it blocks straight away.
+ *
+ * The wake latency, and the check the budget is tuned on, compare a cycle
+ * count the source took on its core with ones the waiter takes on its own.
+ * That assumes the cores' counters run in step, as the TSC does on x86. On
+ * ARM each core has its own PMU counter, started when it calls
+ * sel4bench_init, so the figures are only as good as how closely those
+ * starts line up.
+ */
+
+/* spin before blocking, only when sources run on other cores than the
+ * waiter, see gen_spec.py */
+#define WAIT_SPIN (CONFIG_MAX_NUM_NODES > 1)
+
+/* limits of the spin budget, in cycles */
+#define WAIT_SPIN_MIN 256
+#define WAIT_SPIN_MAX (1 << 20)
+#define WAIT_SPIN_INITIAL 4096
+
+/* check the notification every this many rounds of spinning */
+#define WAIT_POLL_INTERVAL 16
+
+typedef struct {
+    /* return a set bit for each source with work ready, without blocking */
+    seL4_Word (*poll)(void *cookie);
+    /* ask every source to signal when it has work, then check once more.
+     * Returns the sources that had work after all, disarming them. */
+    seL4_Word (*arm)(void *cookie);
+    /* cycle count at which the sources in badge signalled */
+    ccnt_t (*signalled_at)(void *cookie, seL4_Word badge);
+} wait_ops_t;
+
+typedef struct {
+    /* current spin budget in cycles */
+    ccnt_t budget;
+    /* waits that found work while spinning, and rounds spent spinning */
+    uint64_t spins;
+    uint64_t spin_rounds;
+    /* waits that blocked in seL4_Wait */
+    uint64_t blocks;
+    /* cycles from a source signalling to the waiter running again */
+    ccnt_t wake_latency_total;
+    ccnt_t wake_latency_max;
+} wait_state_t;
+
+void wait_init(wait_state_t *state);
+
+/*
+ * Wait for work on ntfn and the sources behind ops. Returns the sources with
+ * work. Sources signal with non-zero badges, so this is never empty.
+ *
+ * If armed is set on return, every source outside the result is armed and
+ * will signal ntfn. Otherwise, sources may be armed or not as before the call.
+ */
+seL4_Word wait_adaptive(wait_state_t *state, seL4_CPtr ntfn, const wait_ops_t *ops, void *cookie,
+                        bool *armed);
+
+/* print the counters */
+void wait_print(wait_state_t *state, const char *name);
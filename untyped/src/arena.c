@@ -0,0 +1,52 @@
+#include <stdio.h>
+#include <sel4/sel4.h>
+#include <utils/util.h>
+#include <vka/object.h>
+
+#include "arena.h"
+
+void arena_init(arena_t *arena, seL4_CPtr cnode, seL4_CPtr untyped, seL4_Word size_bits,
+                seL4_SlotRegion slots)
+{
+    *arena = (arena_t) {
+        .cnode = cnode,
+        .untyped = untyped,
+        .size_bits = size_bits,
+        .slots = slots,
+        .next_slot = slots.start,
+    };
+}
+
+seL4_CPtr arena_alloc(arena_t *arena, seL4_Word type, seL4_Word size_bits)
+{
+    if (arena->next_slot == arena->slots.end)
+    {
+        return seL4_CapNull;
+    }
+    /* the kernel puts each object at the next multiple of its size */
+    seL4_Word object_size = BIT(vka_get_object_size(type, size_bits));
+    seL4_Word start = ROUND_UP(arena->watermark, object_size);
+    if (start + object_size > BIT(arena->size_bits))
+    {
+        return seL4_CapNull;
+    }
+
+    seL4_CPtr slot = arena->next_slot;
+    seL4_Error error = seL4_Untyped_Retype(arena->untyped, type, size_bits, arena->cnode, 0, 0, slot, 1);
+    if (error != seL4_NoError)
+    {
+        ZF_LOGE("Failed to retype an object of type %lu (%d)", (unsigned long) type, error);
+        return seL4_CapNull;
+    }
+    arena->watermark = start + object_size;
+    arena->next_slot++;
+    return slot;
+}
+
+void arena_reset(arena_t *arena)
+{
+    seL4_Error error = seL4_CNode_Revoke(arena->cnode, arena->untyped, seL4_WordBits);
+    ZF_LOGF_IF(error != seL4_NoError, "Failed to revoke the arena's untyped");
+    arena->watermark = 0;
+    arena->next_slot = arena->slots.start;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stddef.h>
+#include <sel4/sel4.h>
+
+/*
+ * An arena of kernel objects retyped from one untyped.
+ *
+ * Objects of any type are created one after another, into slots taken in
+ * order from a region of a CNode. The arena keeps its own copy of the
+ * kernel's watermark in the untyped, aligning each object to its size as the
+ * kernel does, so it can say an object will not fit without asking.
+ *
+ * Nothing is freed on its own. arena_reset revokes the untyped, which
+ * deletes every object and the caps to them in one call, and moves both
+ * watermarks back to the start. The untyped must have no other children.
+ */
+
+typedef struct {
+    seL4_CPtr cnode;
+    seL4_CPtr untyped;
+    seL4_Word size_bits;
+    /* bytes of the untyped used so far */
+    seL4_Word watermark;
+    /* slots for objects, and the next free one */
+    seL4_SlotRegion slots;
+    seL4_CPtr next_slot;
+} arena_t;
+
+/* an arena over the 2^size_bits byte untyped, creating objects into the
+ * empty slots of region in cnode */
+void arena_init(arena_t *arena, seL4_CPtr cnode, seL4_CPtr untyped, seL4_Word size_bits,
+                seL4_SlotRegion slots);
+
+/* a new object of type and size_bits, as for seL4_Untyped_Retype, or
+ * seL4_CapNull if there is no room for it or no slot left */
+seL4_CPtr arena_alloc(arena_t *arena, seL4_Word type, seL4_Word size_bits);
+
+/* delete every object in the arena, and make all of it free again */
+void arena_reset(arena_t *arena);
@@ -0,0 +1,209 @@
+#include <stdio.h>
+#include <sel4/sel4.h>
+#include <utils/util.h>
+
+#include "buddy.h"
+
+static void push_free(buddy_t *buddy, buddy_block_t *block)
+{
+    seL4_Word bits = block->size_bits;
+    block->state = BUDDY_FREE;
+    block->prev = NULL;
+    block->next = buddy->free[bits];
+    if (block->next != NULL)
+    {
+        block->next->prev = block;
+    }
+    buddy->free[bits] = block;
+    buddy->num_free[bits]++;
+    buddy->nonempty |= BIT(bits);
+}
+
+static void unlink_free(buddy_t *buddy, buddy_block_t *block)
+{
+    seL4_Word bits = block->size_bits;
+    if (block->prev != NULL)
+    {
+        block->prev->next = block->next;
+    }
+    else
+    {
+        buddy->free[bits] = block->next;
+    }
+    if (block->next != NULL)
+    {
+        block->next->prev = block->prev;
+    }
+    buddy->num_free[bits]--;
+    if (buddy->free[bits] == NULL)
+    {
+        buddy->nonempty &= ~BIT(bits);
+    }
+}
+
+void buddy_init(buddy_t *buddy, seL4_BootInfo *info, seL4_CPtr cnode, seL4_SlotRegion slots)
+{
+    *buddy = (buddy_t) {
+        .cnode = cnode,
+        .first_untyped = info->untyped.start,
+        .num_untyped = info->untyped.end - info->untyped.start,
+        .first_slot = slots.start,
+        .num_pairs = MIN((slots.end - slots.start) / 2, BUDDY_MAX_PAIRS),
+    };
+    for (size_t i = 0; i < buddy->num_pairs; i++)
+    {
+        buddy->free_pairs[buddy->num_free_pairs++] = buddy->num_pairs - 1 - i;
+    }
+
+    for (size_t i = 0; i < buddy->num_untyped; i++)
+    {
+        seL4_UntypedDesc *desc = &info->untypedList[i];
+        buddy_block_t *block = &buddy->untyped[i];
+        *block = (buddy_block_t) {
+            .cap = info->untyped.start + i,
+            .paddr = desc->paddr,
+            .size_bits = desc->sizeBits,
+            .state = BUDDY_DEVICE,
+        };
+        if (!desc->isDevice)
+        {
+            push_free(buddy, block);
+            buddy->free_bytes += BIT(block->size_bits);
+        }
+    }
+}
+
+/* the other half of the pair a half is in */
+static buddy_block_t *buddy_of(buddy_t *buddy, buddy_block_t *half)
+{
+    return &buddy->halves[(half - buddy->halves) ^ 1];
+}
+
+/* split block into halves and return the first, leaving the second free.
+ * NULL if there are no slots left, or the kernel refused. */
+static buddy_block_t *split(buddy_t *buddy, buddy_block_t *block)
+{
+    if (buddy->num_free_pairs == 0)
+    {
+        return NULL;
+    }
+    size_t pair = buddy->free_pairs[buddy->num_free_pairs - 1];
+    seL4_CPtr slot = buddy->first_slot + 2 * pair;
+    seL4_Word bits = block->size_bits - 1;
+    seL4_Error error = seL4_Untyped_Retype(block->cap, seL4_UntypedObject, bits, buddy->cnode, 0, 0, slot, 2);
+    if (error != seL4_NoError)
+    {
+        ZF_LOGE("Failed to split untyped %lu (%d)", (unsigned long) block->cap, error);
+        return NULL;
+    }
+    buddy->num_free_pairs--;
+    buddy->splits++;
+
+    buddy_block_t *halves = &buddy->halves[2 * pair];
+    for (int i = 0; i < 2; i++)
+    {
+        halves[i] = (buddy_block_t) {
+            .cap = slot + i,
+            .paddr = block->paddr + i * BIT(bits),
+            .size_bits = bits,
+            .parent = block,
+        };
+    }
+    block->state = BUDDY_SPLIT;
+    push_free(buddy, &halves[1]);
+    return &halves[0];
+}
+
+/* make block free, merging it with its buddy for as long as that is free */
+static void release(buddy_t *buddy, buddy_block_t *block)
+{
+    while (block->parent != NULL)
+    {
+        buddy_block_t *other = buddy_of(buddy, block);
+        if (other->state != BUDDY_FREE)
+        {
+            break;
+        }
+        unlink_free(buddy, other);
+        /* with both halves gone the parent has no children, and is whole */
+        seL4_Error error = seL4_CNode_Delete(buddy->cnode, block->cap, seL4_WordBits);
+        ZF_LOGF_IF(error != seL4_NoError, "Failed to delete half of untyped");
+        error = seL4_CNode_Delete(buddy->cnode, other->cap, seL4_WordBits);
+        ZF_LOGF_IF(error != seL4_NoError, "Failed to delete half of untyped");
+        buddy->free_pairs[buddy->num_free_pairs++] = (MIN(block, other) - buddy->halves) / 2;
+        buddy->merges++;
+        block = block->parent;
+    }
+    push_free(buddy, block);
+}
+
+seL4_CPtr buddy_alloc(buddy_t *buddy, seL4_Word size_bits)
+{
+    if (size_bits < seL4_MinUntypedBits || size_bits >= seL4_WordBits)
+    {
+        return seL4_CapNull;
+    }
+    seL4_Word classes = buddy->nonempty & ~MASK(size_bits);
+    if (classes == 0)
+    {
+        return seL4_CapNull;
+    }
+    buddy_block_t *block = buddy->free[CTZL(classes)];
+    unlink_free(buddy, block);
+
+    while (block->size_bits > size_bits)
+    {
+        buddy_block_t *half = split(buddy, block);
+        if (half == NULL)
+        {
+            /* put back what was split so far */
+            release(buddy, block);
+            return seL4_CapNull;
+        }
+        block = half;
+    }
+    block->state = BUDDY_USED;
+    buddy->free_bytes -= BIT(size_bits);
+    buddy->used_bytes += BIT(size_bits);
+    return block->cap;
+}
+
+void buddy_free(buddy_t *buddy, seL4_CPtr untyped)
+{
+    buddy_block_t *block = NULL;
+    if (untyped >= buddy->first_untyped && untyped - buddy->first_untyped < buddy->num_untyped)
+    {
+        block = &buddy->untyped[untyped - buddy->first_untyped];
+    }
+    else if (untyped >= buddy->first_slot && untyped - buddy->first_slot < 2 * buddy->num_pairs)
+    {
+        block = &buddy->halves[untyped - buddy->first_slot];
+    }
+    ZF_LOGF_IF(block == NULL || block->state != BUDDY_USED, "Untyped %lu is not in use",
+               (unsigned long) untyped);
+
+    seL4_Error error = seL4_CNode_Revoke(buddy->cnode, untyped, seL4_WordBits);
+    ZF_LOGF_IF(error != seL4_NoError, "Failed to revoke untyped %lu", (unsigned long) untyped);
+    buddy->free_bytes += BIT(block->size_bits);
+    buddy->used_bytes -= BIT(block->size_bits);
+    release(buddy, block);
+}
+
+void buddy_print_stats(const char *name, buddy_t *buddy)
+{
+    uint64_t largest = buddy->nonempty == 0 ? 0 : BIT(seL4_WordBits - 1 - CLZL(buddy->nonempty));
+    /* in tenths of a percent */
+    unsigned long long fragmentation = buddy->free_bytes == 0 ? 0 :
+                                       1000 - largest * 1000 / buddy->free_bytes;
+    printf("%s: %llu bytes free, %llu used, largest free block %llu, %llu.%llu%% of free memory outside it, "
+           "%llu splits, %llu merges\n", name, (unsigned long long) buddy->free_bytes,
+           (unsigned long long) buddy->used_bytes, (unsigned long long) largest, fragmentation / 10,
+           fragmentation % 10, (unsigned long long) buddy->splits, (unsigned long long) buddy->merges);
+    for (seL4_Word bits = 0; bits < seL4_WordBits; bits++)
+    {
+        if (buddy->num_free[bits] != 0)
+        {
+            printf("%s:   2^%lu: %zu free\n", name, (unsigned long) bits, buddy->num_free[bits]);
+        }
+    }
+}
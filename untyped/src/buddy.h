@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sel4/sel4.h>
+
+/*
+ * A buddy allocator over the untypeds in bootinfo.
+ *
+ * Each non-device bootinfo untyped is a block. A request for 2^n bytes takes
+ * a free block from the smallest size class that has one, and splits it in
+ * halves, by retyping it into two untypeds, until it is 2^n. Freeing a block
+ * revokes it, and merges it back with its buddy, deleting both halves, for
+ * as long as the buddy is free too. The free blocks of each size are kept
+ * in a list, with a bit per size class saying which have any, so both take
+ * time in the number of size classes.
+ *
+ * Split halves take two consecutive slots from the region given at init.
+ * A free block has no children, so the kernel retypes it from its start.
+ */
+
+/* most splits outstanding at once */
+#define BUDDY_MAX_PAIRS 512
+
+typedef enum {
+    BUDDY_FREE,
+    BUDDY_USED,
+    BUDDY_SPLIT,
+    /* a device untyped, never handed out */
+    BUDDY_DEVICE,
+} buddy_state_t;
+
+typedef struct buddy_block {
+    seL4_CPtr cap;
+    uintptr_t paddr;
+    seL4_Word size_bits;
+    buddy_state_t state;
+    /* the block this is half of, NULL for a bootinfo untyped */
+    struct buddy_block *parent;
+    /* links in the free list of its size, while free */
+    struct buddy_block *prev;
+    struct buddy_block *next;
+} buddy_block_t;
+
+typedef struct {
+    seL4_CPtr cnode;
+    /* bootinfo untypeds, from the cap of the first */
+    seL4_CPtr first_untyped;
+    size_t num_untyped;
+    buddy_block_t untyped[CONFIG_MAX_NUM_BOOTINFO_UNTYPED_CAPS];
+    /* halves, in pairs, each in the slot first_slot + its index */
+    seL4_CPtr first_slot;
+    size_t num_pairs;
+    buddy_block_t halves[2 * BUDDY_MAX_PAIRS];
+    /* pairs not in use, as a stack */
+    size_t num_free_pairs;
+    size_t free_pairs[BUDDY_MAX_PAIRS];
+    /* free blocks of each size, and the sizes that have any */
+    buddy_block_t *free[seL4_WordBits];
+    size_t num_free[seL4_WordBits];
+    seL4_Word nonempty;
+    uint64_t free_bytes;
+    uint64_t used_bytes;
+    uint64_t splits;
+    uint64_t merges;
+} buddy_t;
+
+/* manage the untypeds in info, splitting them into the slots of region in
+ * cnode, which must be empty */
+void buddy_init(buddy_t *buddy, seL4_BootInfo *info, seL4_CPtr cnode, seL4_SlotRegion slots);
+
+/* an untyped of 2^size_bits bytes, or seL4_CapNull if there is no free
+ * block that big or no slots to split one */
+seL4_CPtr buddy_alloc(buddy_t *buddy, seL4_Word size_bits);
+
+/* revoke an untyped from buddy_alloc, deleting everything retyped from it,
+ * and make it free again */
+void buddy_free(buddy_t *buddy, seL4_CPtr untyped);
+
+/* print how much is free and used, the free blocks of each size, and the
+ * share of the free memory outside the largest free block */
+void buddy_print_stats(const char *name, buddy_t *buddy);
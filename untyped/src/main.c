@@ -3,6 +3,136 @@
 #include <sel4/sel4.h>
 #include <sel4platsupport/bootinfo.h>
 #include <utils/util.h>
+#include <sel4utils/mapping.h>
+#include <sel4bench/sel4bench.h>
+
+#include "arena.h"
+#include "buddy.h"
+
+// sessions of objects created and destroyed by arena_sessions
+#define ARENA_SESSIONS 256
+
+// blocks kept at once, and allocations and frees made, by buddy_churn
+#define CHURN_LIVE 128
+#define CHURN_OPS 4096
+
+// allocate and free untypeds of 4K to 64K at random through a buddy
+// allocator over all of bootinfo's untypeds, and print what it costs
+static void buddy_churn(seL4_BootInfo *info, seL4_SlotRegion slots)
+{
+    static buddy_t buddy;
+    buddy_init(&buddy, info, seL4_CapInitThreadCNode, slots);
+    buddy_print_stats("buddy", &buddy);
+
+    seL4_CPtr live[CHURN_LIVE] = {0};
+    uint32_t seed = 1;
+    ccnt_t alloc_cycles = 0, free_cycles = 0;
+    size_t allocs = 0, frees = 0, failed = 0;
+    for (int i = 0; i < CHURN_OPS; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        seL4_CPtr *block = &live[(seed >> 16) % CHURN_LIVE];
+        ccnt_t start = sel4bench_get_cycle_count();
+        if (*block != seL4_CapNull)
+        {
+            buddy_free(&buddy, *block);
+            free_cycles += sel4bench_get_cycle_count() - start;
+            *block = seL4_CapNull;
+            frees++;
+        }
+        else
+        {
+            *block = buddy_alloc(&buddy, seL4_PageBits + (seed >> 8) % 5);
+            alloc_cycles += sel4bench_get_cycle_count() - start;
+            if (*block == seL4_CapNull)
+            {
+                failed++;
+            }
+            allocs++;
+        }
+    }
+
+    buddy_print_stats("buddy", &buddy);
+    printf("buddy: %zu allocations at %llu cycles each, %zu failed, %zu frees at %llu cycles each\n",
+           allocs, (unsigned long long)(allocs ? alloc_cycles / allocs : 0), failed, frees,
+           (unsigned long long)(frees ? free_cycles / frees : 0));
+}
+
+// the objects of one session: a TCB, endpoints, notifications and frames
+static const struct {
+    seL4_Word type;
+    seL4_Word size_bits;
+    int count;
+} session[] = {
+    {seL4_TCBObject, 0, 1},
+    {seL4_EndpointObject, 0, 4},
+    {seL4_NotificationObject, 0, 2},
+    {seL4_ARCH_4KPage, seL4_PageBits, 4},
+};
+
+// create a session's objects from an arena
+static int fill_session(arena_t *arena, seL4_CPtr *objects)
+{
+    int num_objects = 0;
+    for (size_t i = 0; i < ARRAY_SIZE(session); i++)
+    {
+        for (int j = 0; j < session[i].count; j++)
+        {
+            objects[num_objects] = arena_alloc(arena, session[i].type, session[i].size_bits);
+            ZF_LOGF_IF(objects[num_objects] == seL4_CapNull, "Failed to allocate from the arena");
+            num_objects++;
+        }
+    }
+    return num_objects;
+}
+
+// create and destroy the objects of many sessions in an arena, and compare
+// deleting them all with one revoke to deleting each one
+static void arena_sessions(seL4_BootInfo *info, seL4_SlotRegion slots)
+{
+    seL4_CPtr untyped = seL4_CapNull;
+    seL4_Word size_bits = 0;
+    for (int i = 0; i < (info->untyped.end - info->untyped.start); i++)
+    {
+        if (info->untypedList[i].sizeBits >= seL4_PageBits + 4 && !info->untypedList[i].isDevice)
+        {
+            untyped = info->untyped.start + i;
+            size_bits = info->untypedList[i].sizeBits;
+            break;
+        }
+    }
+    ZF_LOGF_IF(untyped == seL4_CapNull, "No untyped big enough for the arena");
+
+    arena_t arena;
+    arena_init(&arena, seL4_CapInitThreadCNode, untyped, size_bits, slots);
+
+    seL4_CPtr objects[16];
+    ccnt_t reset_cycles = 0, delete_cycles = 0;
+    int num_objects = 0;
+    for (int i = 0; i < ARENA_SESSIONS; i++)
+    {
+        num_objects = fill_session(&arena, objects);
+        ccnt_t start = sel4bench_get_cycle_count();
+        if (i % 2 == 0)
+        {
+            arena_reset(&arena);
+            reset_cycles += sel4bench_get_cycle_count() - start;
+        }
+        else
+        {
+            for (int j = 0; j < num_objects; j++)
+            {
+                seL4_CNode_Delete(seL4_CapInitThreadCNode, objects[j], seL4_WordBits);
+            }
+            delete_cycles += sel4bench_get_cycle_count() - start;
+            // nothing left to revoke, but the watermarks go back to the start
+            arena_reset(&arena);
+        }
+    }
+    printf("arena: %d objects a session, %llu cycles to revoke them, %llu to delete each\n", num_objects,
+           (unsigned long long)(reset_cycles / (ARENA_SESSIONS / 2)),
+           (unsigned long long)(delete_cycles / (ARENA_SESSIONS / 2)));
+}
 
 int main(int argc, char *argv[])
 {
@@ -80,6 +210,12 @@ int main(int argc, char *argv[])
     error = seL4_Untyped_Retype(child_untyped, seL4_EndpointObject, 0, seL4_CapInitThreadCNode, 0, 0, child_tcb, num_eps);
     ZF_LOGF_IF(error != seL4_NoError, "Failed to create endpoints.");
 
+    // give it all back, and share out every untyped with a buddy allocator
+    seL4_CNode_Revoke(seL4_CapInitThreadCNode, parent_untyped, seL4_WordBits);
+    sel4bench_init();
+    arena_sessions(info, info->empty);
+    buddy_churn(info, info->empty);
+
     printf("Success\n");
 
     return 0;